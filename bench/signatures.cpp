@@ -0,0 +1,65 @@
+// benchmark for signature matching against set intersection
+// build and run from the repo root:
+//   g++ -std=c++17 -O2 -pthread bench/signatures.cpp -o signatures_bench && ./signatures_bench [entities] [rounds]
+// finds every entity with A and B but not C, once through findEntities (a scan over the signature array)
+// and once through std::set_intersection + std::set_difference over the component entity sets
+#include "../ecpps.h"
+#include <cstdlib>
+
+using namespace ecpps;
+
+struct A : Component { float v = 0; };
+struct B : Component { float v = 0; };
+struct C : Component {};
+
+int main(int argc, char** argv){
+    long entities = argc > 1 ? std::atol(argv[1]) : 200000;
+    int rounds = argc > 2 ? std::atoi(argv[2]) : 50;
+
+    ECSManager manager;
+    vector<ID> ids;
+    for(long i = 0; i < entities; i++){
+        ids.emplace_back(manager.createEntity().getID());
+    }
+    // half have A, a third have B, a fifth are tagged C
+    for(long i = 0; i < entities; i++){
+        if(i % 2 == 0){ manager.addComponent<A>(ids[i], A()); }
+        if(i % 3 == 0){ manager.addComponent<B>(ids[i], B()); }
+        if(i % 5 == 0){ manager.addComponent<C>(ids[i], C()); }
+    }
+    manager.groupEntities<A>();
+    manager.groupEntities<B>();
+    manager.groupEntities<C>();
+
+    vector<ID> out;
+    auto start = std::chrono::steady_clock::now();
+    size_t signatureMatches = 0;
+    for(int round = 0; round < rounds; round++){
+        signatureMatches += manager.findEntities<A, B>(out, makeSignature<C>());
+    }
+    auto middle = std::chrono::steady_clock::now();
+    size_t setMatches = 0;
+    vector<ID> both, result;
+    for(int round = 0; round < rounds; round++){
+        both.clear();
+        result.clear();
+        set<ID>& withA = manager.getComponentEntities<A>();
+        set<ID>& withB = manager.getComponentEntities<B>();
+        set<ID>& withC = manager.getComponentEntities<C>();
+        std::set_intersection(withA.begin(), withA.end(), withB.begin(), withB.end(), std::back_inserter(both));
+        std::set_difference(both.begin(), both.end(), withC.begin(), withC.end(), std::back_inserter(result));
+        setMatches += result.size();
+    }
+    auto end = std::chrono::steady_clock::now();
+
+    if(signatureMatches != setMatches){
+        std::cout << "FAIL: signatures found " << signatureMatches << ", sets found " << setMatches << std::endl;
+        return 1;
+    }
+    double signatureMs = std::chrono::duration<double, std::milli>(middle - start).count() / rounds;
+    double setMs = std::chrono::duration<double, std::milli>(end - middle).count() / rounds;
+    std::cout << entities << " entities, " << signatureMatches / rounds << " matches per query" << std::endl;
+    std::cout << "signatures: " << signatureMs << " ms per query" << std::endl;
+    std::cout << "sets:       " << setMs << " ms per query" << std::endl;
+    return 0;
+}
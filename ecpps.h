@@ -9,6 +9,54 @@
 #include <typeinfo>
 #include <memory>
 #include <cstdarg>
+#include <chrono>
+#include <algorithm>
+#include <ostream>
+#include <iomanip>
+#include <cstddef>
+#include <functional>
+#include <limits>
+#include <unordered_map>
+#include <cstdint>
+#include <cmath>
+#include <type_traits>
+#include <atomic>
+#include <string_view>
+#include <future>
+#include <queue>
+#include <tuple>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <exception>
+#include <cctype>
+#include <fstream>
+#include <cstring>
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+// std::span needs C++20, a minimal stand in is used otherwise
+#if __has_include(<span>) && __cplusplus > 201703L
+#include <span>
+#endif
+// memory mapped component storage needs POSIX mmap
+#if __has_include(<sys/mman.h>) && __has_include(<sys/file.h>) && __has_include(<fcntl.h>) && __has_include(<unistd.h>)
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/file.h>
+#include <fcntl.h>
+#include <unistd.h>
+#define ECPPS_MMAP 1
+#endif
+// coroutine based systems need C++20
+#if defined(__cpp_impl_coroutine) && __has_include(<coroutine>)
+#include <coroutine>
+#define ECPPS_COROUTINES 1
+#endif
+#if __has_include(<cxxabi.h>)
+#include <cxxabi.h>
+#include <cstdlib>
+#endif
 
 using std::vector;
 using std::string;
@@ -22,11 +70,122 @@ using std::unique_ptr;
 // the goal of this system is to provide an OOP-style interface
 // while maintaining DDP-style performance undernearth
 
+// most component types a program can use, sets the width of entity signatures (multiple of 64)
+#ifndef ECPPS_MAX_COMPONENTS
+#define ECPPS_MAX_COMPONENTS 256
+#endif
+
+// components per page for paged storage
+#ifndef ECPPS_PAGE_SIZE
+#define ECPPS_PAGE_SIZE 256
+#endif
+
+// ids a thread reserves at a time with ECSManager::reserveEntity
+#ifndef ECPPS_ID_BLOCK
+#define ECPPS_ID_BLOCK 64
+#endif
+
+// number of samples kept per system for rolling timing stats
+#ifndef ECPPS_PROFILE_WINDOW
+#define ECPPS_PROFILE_WINDOW 128
+#endif
+
 namespace ecpps {
 typedef unsigned ID;
+// id that never belongs to an entity, used for "no parent" and similar links
+constexpr ID nullEntity = std::numeric_limits<ID>::max();
 class ECSManager;
 class ComponentManager;
 
+// contiguous view over packed storage
+#if defined(__cpp_lib_span)
+template <typename T> using Span = std::span<T>;
+#else
+template <typename T>
+class Span {
+    private:
+        T* pointer = nullptr;
+        size_t count = 0;
+    public:
+        Span() = default;
+        Span(T* pointer, size_t count) : pointer(pointer), count(count) {};
+        T* data() const { return pointer; };
+        size_t size() const { return count; };
+        bool empty() const { return count == 0; };
+        T& operator[](size_t index) const { return pointer[index]; };
+        T* begin() const { return pointer; };
+        T* end() const { return pointer + count; };
+};
+#endif
+
+// hashes a name with 64-bit FNV-1a (never returns 0, that marks an empty registry slot)
+constexpr uint64_t hashName(std::string_view text){
+    uint64_t hash = 14695981039346656037ull;
+    for(char c : text){
+        hash = (hash ^ static_cast<unsigned char>(c)) * 1099511628211ull;
+    }
+    return hash == 0 ? 1 : hash;
+}
+
+// compact handle for a special entity name
+// built from a string at runtime, or at compile time with the "player"_name literal
+struct EntityName {
+    uint64_t hash;
+    constexpr EntityName(const char* text) : hash(hashName(text)) {};
+    constexpr EntityName(std::string_view text) : hash(hashName(text)) {};
+    EntityName(const string& text) : hash(hashName(text)) {};
+    constexpr bool operator==(const EntityName& other) const { return hash == other.hash; };
+};
+
+namespace literals {
+    // compile-time hashed entity name, e.g. manager.getSpecialEntity("player"_name)
+    constexpr EntityName operator""_name(const char* text, size_t length){
+        return EntityName(std::string_view(text, length));
+    }
+}
+
+// one slot in the special entity table
+struct SpecialEntitySlot {
+    // hash of the name (0 means the slot was never used)
+    uint64_t hash = 0;
+    // entity stored under the name (nullEntity once removed)
+    ID entity = nullEntity;
+};
+
+// returns a readable name for a type (demangled where the compiler allows it)
+template <typename T> inline string typeName();
+// estimates the heap bytes used by one node of a std::map/std::set holding V
+template <typename V> constexpr size_t treeNodeBytes();
+// index of the lowest set bit (word must not be 0)
+inline unsigned lowestBit(uint64_t word);
+// index of the highest set bit (word must not be 0)
+inline unsigned highestBit(uint64_t word);
+// small dense number per type, used to index per-type slots directly
+template <typename T> inline unsigned typeIndex();
+// bit a component type owns in entity signatures
+template <typename T> inline unsigned componentBit();
+
+// number of 64 bit words in a signature
+constexpr unsigned signatureWords = (ECPPS_MAX_COMPONENTS + 63) / 64;
+// signature bit set on every live entity (component bits start after the reserved ones)
+constexpr unsigned aliveBit = 0;
+// signature bit set while an entity is disabled
+constexpr unsigned disabledBit = 1;
+constexpr unsigned reservedSignatureBits = 2;
+
+// fixed width bitmask of which components an entity has
+struct Signature {
+    uint64_t words[signatureWords] = {};
+    void set(unsigned bit) { words[bit / 64] |= uint64_t(1) << (bit % 64); };
+    void reset(unsigned bit) { words[bit / 64] &= ~(uint64_t(1) << (bit % 64)); };
+    bool test(unsigned bit) const { return (words[bit / 64] >> (bit % 64)) & 1; };
+    // has every bit of all and none of the bits of none
+    inline bool matches(const Signature& all, const Signature& none) const;
+};
+
+// builds a signature with the bits of every component type in Ts
+template <typename... Ts> inline Signature makeSignature();
+
 // ####### Class definitions ####### //
 
 // wrapper class, entity is really just an ID but this gives OOP approach to management. serves as a reference point for components
@@ -44,7 +203,7 @@ class Entity {
         // adds component to manager with entity id
         template <typename T> inline void addComponent(T component);
         // return's entity id
-        inline ID getID();
+        inline ID getID() const;
         // used to destroy object for all component managers and delete self from manager
         inline void destroy();
 };
@@ -57,11 +216,117 @@ struct Component {
 struct RenderComponent : public Component {
 };
 
+// links an entity into the scene hierarchy
+// maintained by ECSManager, use setParent rather than editing the links by hand
+struct Hierarchy : public Component {
+    // entity this one is attached to
+    ID parent = nullEntity;
+    // head of this entity's child list
+    ID firstChild = nullEntity;
+    // neighbours in the parent's child list
+    ID nextSibling = nullEntity;
+    ID prevSibling = nullEntity;
+    // number of ancestors (roots are 0)
+    unsigned depth = 0;
+    // whether this entity's transform changed since the last propagation
+    bool dirty = true;
+};
+
+// one slot in the depth-ordered hierarchy list
+struct HierarchyNode {
+    ID entity;
+    // slot of the parent in the same list (always lower), or -1 for roots
+    unsigned parentSlot;
+    // the entity's links, valid until the hierarchy storage changes shape
+    Hierarchy* links;
+};
+
+// Local and World of every hierarchyOrder slot (nullptr where missing), cached by propagateTransforms
+template <typename Local, typename World>
+struct TransformSlots {
+    // layouts the pointers were taken from
+    uint64_t orderVersion = 0;
+    uint64_t localVersion = 0;
+    uint64_t worldVersion = 0;
+    vector<const Local*> locals;
+    vector<World*> worlds;
+};
+
+// memory used by a single component type, all sizes in bytes
+struct ComponentMemoryStats {
+    // name of the component type
+    string name;
+    // number of live components
+    size_t count = 0;
+    // number of components the dense storage can hold before reallocating
+    size_t capacity = 0;
+    // bytes allocated for the dense component data (capacity * sizeof)
+    size_t denseBytes = 0;
+    // bytes used by the entity -> index map and entity sets
+    size_t indexBytes = 0;
+    // bytes of dense data allocated but not holding a live component
+    size_t slackBytes = 0;
+};
+
+// memory used by a whole ECSManager, all sizes in bytes
+struct MemoryStats {
+    // one entry per component type
+    vector<ComponentMemoryStats> components;
+    // number of live entities
+    size_t entityCount = 0;
+    // bytes used by entity records (entity map, signatures and special entity table)
+    size_t entityBytes = 0;
+    // number of IDs waiting to be reused
+    size_t recycledIDs = 0;
+    // bytes allocated for the recycled ID links
+    size_t recycledIDBytes = 0;
+    // sum of dense + index bytes over all component types
+    size_t componentBytes = 0;
+    // everything above added together
+    size_t totalBytes = 0;
+};
+
+// one component pulled out of a world, waiting to be added to another
+class IComponentPacket {
+    public:
+        virtual ~IComponentPacket() = default;
+        // adds the component to an entity in the destination world
+        virtual void insert(ECSManager& manager, ID entityID)=0;
+};
+
+template <typename T>
+class ComponentPacket : public IComponentPacket {
+    private:
+        T component;
+    public:
+        ComponentPacket(T component) : component(std::move(component)) {};
+        inline void insert(ECSManager& manager, ID entityID) override;
+};
+
+// everything needed to recreate an entity in another world
+struct EntityPacket {
+    vector<unique_ptr<IComponentPacket>> components;
+};
+
 // class for maintaining component vector and entity indexes
 class IComponentVector {
     private:
+    protected:
+        // bumped whenever components are added, removed or moved, so cached pointers know they're stale
+        uint64_t layoutVersion = 0;
     public:
+        uint64_t structureVersion() const { return layoutVersion; };
         virtual void removeEntity(ID entityID)=0;
+        // removes an entity's component and hands it back packed up (nullptr if it had none)
+        virtual unique_ptr<IComponentPacket> extractEntity(ID entityID)=0;
+        virtual ComponentMemoryStats memoryStats()=0;
+        virtual bool hasEntity(ID entityID)=0;
+        // bit this component type owns in entity signatures
+        virtual unsigned signatureBit()=0;
+        // returns a description of the first broken internal invariant, or an empty string
+        virtual string checkInvariants(const std::function<bool(ID)>& isLive)=0;
+        // publishes this frame's writes to readers (only double buffered storage has anything to do)
+        virtual void swapBuffers() {};
 };
 
 // class for maintaining component vector and entity indexes
@@ -76,29 +341,545 @@ class ComponentVector : public IComponentVector {
         set<ID> entities;
         // holds a seperate list of entities to init
         set<ID> newEntities;
-        // private function for getting pointer
-        vector<T>& getComponentVector() { return components; };
+        // owner of each component, parallel to components
+        vector<ID> componentIDs;
+    public:
+        inline void addComponent(ID entityID, T component);
+        inline void addComponents(const ID* entityIDs, size_t count, const T& component);
+        // adds values[i] to entityIDs[i], one bulk insert for a whole column
+        inline void addComponents(const ID* entityIDs, const T* values, size_t count);
+        // packed components, valid until the next add or remove of this type (or a reorder by propagateTransforms)
+        Span<T> data() { return Span<T>(components.data(), components.size()); };
+        // entity owning each packed component, same order as data()
+        Span<const ID> ids() { return Span<const ID>(componentIDs.data(), componentIDs.size()); };
+        // moves the listed entities' components to the front in that order, the rest follow in their old order
+        inline void reorder(const vector<ID>& order);
+        inline set<ID>& getComponentEntities();
+        inline set<ID>& getNewComponentEntities();
+        inline void groupEntities();
+        inline void removeEntity(ID entityID) override;
+        inline unique_ptr<IComponentPacket> extractEntity(ID entityID) override;
+        inline T& getComponent(ID entityID);
+        inline ComponentMemoryStats memoryStats() override;
+        inline bool hasEntity(ID entityID) override;
+        unsigned signatureBit() override { return componentBit<T>(); };
+        inline string checkInvariants(const std::function<bool(ID)>& isLive) override;
+};
+
+// storage for empty (tag) component types, which carry no data
+// keeps a single bit per entity instead of an index, set node and vector slot
+// tags skip the init stage, they are grouped as soon as they are added
+template <typename T>
+class TagVector : public IComponentVector {
+    private:
+        // one bit per entity ID
+        vector<uint64_t> bits;
+        // number of set bits
+        size_t count = 0;
+        // every tag is the same empty value, so one instance serves all entities
+        T tag;
+        // set of tagged entities, only built if someone asks for it
+        set<ID> entitySet;
+        bool entitySetStale = false;
+        // tags have no init stage, so this is always empty
+        set<ID> newEntities;
+    public:
+        inline void addComponent(ID entityID, T component);
+        inline void addComponents(const ID* entityIDs, size_t count, const T& component);
+        // adds values[i] to entityIDs[i], one bulk insert for a whole column
+        inline void addComponents(const ID* entityIDs, const T* values, size_t count);
+        inline set<ID>& getComponentEntities();
+        inline set<ID>& getNewComponentEntities();
+        inline void groupEntities();
+        inline void removeEntity(ID entityID) override;
+        inline unique_ptr<IComponentPacket> extractEntity(ID entityID) override;
+        inline T& getComponent(ID entityID);
+        inline ComponentMemoryStats memoryStats() override;
+        inline bool hasEntity(ID entityID) override;
+        unsigned signatureBit() override { return componentBit<T>(); };
+        inline string checkInvariants(const std::function<bool(ID)>& isLive) override;
+        // calls f(id) for every tagged entity in id order, without building a set
+        template <typename F> inline void forEach(F f);
+};
+
+// storage for components whose references must stay valid
+// components live in fixed size pages that are never moved, removal leaves a hole that a later add reuses
+template <typename T>
+class PagedVector : public IComponentVector {
+    private:
+        // one block of slots, allocated once and never moved
+        struct Page {
+            alignas(T) unsigned char bytes[sizeof(T) * ECPPS_PAGE_SIZE];
+            // owner of each slot (nullEntity for holes)
+            ID ids[ECPPS_PAGE_SIZE];
+            Page() { std::fill(ids, ids + ECPPS_PAGE_SIZE, nullEntity); };
+            T* slots() { return reinterpret_cast<T*>(bytes); };
+        };
+        vector<unique_ptr<Page>> pages;
+        // holds slot of entityID (page * page size + offset)
+        map<ID, unsigned> indexes;
+        // holes left by removals
+        vector<unsigned> freeSlots;
+        // slots handed out so far, holes included
+        unsigned slotCount = 0;
+        // holds a list of entities
+        set<ID> entities;
+        // holds a seperate list of entities to init
+        set<ID> newEntities;
+        // finds a slot for a new component
+        inline unsigned allocateSlot(ID entityID);
+        T* slot(unsigned index) { return pages[index / ECPPS_PAGE_SIZE]->slots() + index % ECPPS_PAGE_SIZE; };
+    public:
+        PagedVector() = default;
+        PagedVector(const PagedVector&) = delete;
+        PagedVector& operator=(const PagedVector&) = delete;
+        inline ~PagedVector();
+        inline void addComponent(ID entityID, T component);
+        inline void addComponents(const ID* entityIDs, size_t count, const T& component);
+        // adds values[i] to entityIDs[i], one bulk insert for a whole column
+        inline void addComponents(const ID* entityIDs, const T* values, size_t count);
+        inline set<ID>& getComponentEntities();
+        inline set<ID>& getNewComponentEntities();
+        inline void groupEntities();
+        inline void removeEntity(ID entityID) override;
+        inline unique_ptr<IComponentPacket> extractEntity(ID entityID) override;
+        inline T& getComponent(ID entityID);
+        inline ComponentMemoryStats memoryStats() override;
+        inline bool hasEntity(ID entityID) override;
+        unsigned signatureBit() override { return componentBit<T>(); };
+        inline string checkInvariants(const std::function<bool(ID)>& isLive) override;
+        // calls f(Span<T> slots, Span<const ID> ids) once per page
+        // slots whose id is nullEntity are holes and hold no component
+        template <typename F> inline void forEachPage(F f);
+        // calls f(id, component) for every component, page order
+        template <typename F> inline void forEach(F f);
+};
+
+#ifdef ECPPS_MMAP
+// a file mapped into memory that can grow a page at a time
+class MappedFile {
+    private:
+        int fd = -1;
+        void* base = nullptr;
+        size_t length = 0;
+        bool readOnly = false;
+        string path;
+        // private files are deleted when closed
+        bool removeOnClose = false;
+        inline void unmap();
+    public:
+        MappedFile() = default;
+        MappedFile(const MappedFile&) = delete;
+        MappedFile& operator=(const MappedFile&) = delete;
+        inline ~MappedFile();
+        // opens and maps a file, a writable file is locked and created (or emptied) first
+        // (throws if another writer already has it open)
+        inline void open(const string& path, bool readOnly);
+        // grows the file to at least bytes (whole pages) and remaps it, contents are kept
+        inline void reserve(size_t bytes);
+        // picks up growth made by a writer in another process (read only files)
+        inline void refresh();
+        // deletes the file when it's closed, for files nobody else is meant to read
+        void removeWhenClosed() { removeOnClose = true; };
+        void* data() const { return base; };
+        size_t size() const { return length; };
+};
+
+// start of a mapped column's id file
+struct MappedHeader {
+    uint64_t magic;
+    uint64_t elementSize;
+    uint64_t count;
+};
+
+// storage that keeps a component column in memory mapped files, for worlds bigger than RAM
+// components go in <path>, their owners (after a small header) in <path>.ids, the OS pages cold data in and out
+// the same files can be opened read only by another process to inspect a live world
+// T must be trivially copyable since it's written straight to disk
+// like tags, mapped components skip the init stage and are grouped as soon as they are added
+template <typename T>
+class MappedVector : public IComponentVector {
+    static_assert(std::is_trivially_copyable<T>::value, "error: mapped components must be trivially copyable");
+    private:
+        MappedFile dataFile;
+        MappedFile idFile;
+        bool readOnly;
+        // slot of each entity, indexed by ID (nullEntity if it has none), kept in RAM
+        vector<unsigned> positions;
+        // set of entities, only built if someone asks for it
+        set<ID> entitySet;
+        bool entitySetStale = false;
+        // components are grouped on add, so this is always empty
+        set<ID> newEntities;
+        // components this reader can see, the header's count clamped to what is mapped
+        // (the writer moves the header on without waiting for readers to refresh)
+        size_t readableCount = 0;
+        MappedHeader* header() const { return static_cast<MappedHeader*>(idFile.data()); };
+        // components in the column, never more than are mapped
+        size_t count() const { return readOnly ? readableCount : header()->count; };
+        T* components() const { return static_cast<T*>(dataFile.data()); };
+        ID* componentIDs() const { return reinterpret_cast<ID*>(header() + 1); };
+        // makes room for count components
+        inline void grow(size_t count);
+        inline void checkWritable();
+        // rebuilds positions from the id file
+        inline void rebuildPositions();
+    public:
+        // creates a writable column at path (emptying any old one), or opens an existing one read only
+        inline MappedVector(const string& path, bool readOnly = false);
+        // deletes both files when this storage goes away (writable columns nobody else will open)
+        inline void removeFilesWhenClosed();
+        inline void addComponent(ID entityID, T component);
+        inline void addComponents(const ID* entityIDs, size_t count, const T& component);
+        // adds values[i] to entityIDs[i], one bulk insert for a whole column
+        inline void addComponents(const ID* entityIDs, const T* values, size_t count);
+        inline set<ID>& getComponentEntities();
+        inline set<ID>& getNewComponentEntities();
+        inline void groupEntities();
+        inline void removeEntity(ID entityID) override;
+        inline unique_ptr<IComponentPacket> extractEntity(ID entityID) override;
+        inline T& getComponent(ID entityID);
+        inline ComponentMemoryStats memoryStats() override;
+        inline bool hasEntity(ID entityID) override;
+        unsigned signatureBit() override { return componentBit<T>(); };
+        inline string checkInvariants(const std::function<bool(ID)>& isLive) override;
+        // packed components, valid until the next add or remove of this type
+        Span<T> data() { return Span<T>(components(), count()); };
+        // entity owning each packed component, same order as data()
+        Span<const ID> ids() { return Span<const ID>(componentIDs(), count()); };
+        // read only columns: picks up whatever the writer has added or removed since the last call
+        // (until then data() and ids() keep the length seen at the last refresh)
+        inline void refresh();
+};
+#endif
+
+// storage that keeps two copies of every component so another thread can read last frame's values
+// writers (update) go through the back copy, readers (render) get a const view of the front copy
+// swapBuffers flips them in O(1), then copies forward only what changed: components written through
+// getComponent or flagged with markDirty (ECSManager::markChanged), the slots that adds and removes
+// touched, and everything only if the back was handed out whole through data()
+// swapBuffers must run while nobody is reading the front, at the frame's sync point
+template <typename T>
+class BufferedVector : public IComponentVector {
+    private:
+        // one full copy: components, their owners and the slot of each entity
+        struct Buffer {
+            vector<T> components;
+            vector<ID> componentIDs;
+            // slot of each entity, indexed by ID (nullEntity if it has none)
+            vector<unsigned> positions;
+        };
+        Buffer buffers[2];
+        // which buffer writers use
+        unsigned back = 0;
+        // holds a list of entities
+        set<ID> entities;
+        // holds a seperate list of entities to init
+        set<ID> newEntities;
+        // entities written this frame, and a flag per ID so each is listed once
+        vector<ID> dirty;
+        vector<bool> dirtyFlags;
+        // components were added or removed this frame
+        bool structureChanged = false;
+        // back slots written by adds and removes this frame, and entities that lost their component
+        vector<unsigned> touchedSlots;
+        vector<ID> removedIDs;
+        // data() handed out the whole back, so every component may have been written
+        bool allDirty = false;
+        Buffer& backBuffer() { return buffers[back]; };
+        Buffer& frontBuffer() { return buffers[back ^ 1]; };
     public:
         inline void addComponent(ID entityID, T component);
+        inline void addComponents(const ID* entityIDs, size_t count, const T& component);
+        // adds values[i] to entityIDs[i], one bulk insert for a whole column
+        inline void addComponents(const ID* entityIDs, const T* values, size_t count);
         inline set<ID>& getComponentEntities();
         inline set<ID>& getNewComponentEntities();
         inline void groupEntities();
         inline void removeEntity(ID entityID) override;
+        inline unique_ptr<IComponentPacket> extractEntity(ID entityID) override;
+        // gets the back (writable) copy and flags it as written, so the change reaches readers
         inline T& getComponent(ID entityID);
+        // gets the back copy without flagging it, whoever writes through it must call markDirty
+        inline T* peek(ID entityID);
+        inline ComponentMemoryStats memoryStats() override;
+        inline bool hasEntity(ID entityID) override;
+        unsigned signatureBit() override { return componentBit<T>(); };
+        inline string checkInvariants(const std::function<bool(ID)>& isLive) override;
+        inline void swapBuffers() override;
+        // flags an entity's component as written this frame
+        inline void markDirty(ID entityID);
+        // packed back components and their owners, for writers (the next swap copies every component forward)
+        inline Span<T> data();
+        Span<const ID> ids() { return Span<const ID>(backBuffer().componentIDs.data(), backBuffer().componentIDs.size()); };
+        // last swapped state, for readers on another thread
+        inline const T& read(ID entityID);
+        inline bool frontHas(ID entityID);
+        Span<const T> frontData() { return Span<const T>(frontBuffer().components.data(), frontBuffer().components.size()); };
+        Span<const ID> frontIDs() { return Span<const ID>(frontBuffer().componentIDs.data(), frontBuffer().componentIDs.size()); };
+};
+
+// how a component type is stored
+enum class StorageMode {
+    // packed vector, fastest iteration, references move on add/remove
+    Dense,
+    // fixed pages, references stay valid for the entity's lifetime
+    Paged,
+    // packed columns in memory mapped files (see ECSManager::setMappedDirectory)
+    // falls back to Dense where mmap isn't available
+    Mapped,
+    // two copies, readers on another thread see the last swapped frame (see ECSManager::swapBuffers)
+    Buffered
 };
 
+// per type storage choice, specialize to change it, e.g.
+// template <> struct ecpps::StorageTraits<Enemy> { static constexpr StorageMode mode = StorageMode::Paged; };
+template <typename T>
+struct StorageTraits {
+    static constexpr StorageMode mode = StorageMode::Dense;
+};
+
+// storage picked for a StorageMode
+template <typename T, StorageMode mode> struct StorageFor { using type = ComponentVector<T>; };
+template <typename T> struct StorageFor<T, StorageMode::Paged> { using type = PagedVector<T>; };
+template <typename T> struct StorageFor<T, StorageMode::Buffered> { using type = BufferedVector<T>; };
+#ifdef ECPPS_MMAP
+template <typename T> struct StorageFor<T, StorageMode::Mapped> { using type = MappedVector<T>; };
+#endif
+
+// picks the storage for a component type (empty types are tags, others follow StorageTraits)
+template <typename T>
+using ComponentStorage = typename std::conditional<std::is_empty<T>::value, TagVector<T>,
+    typename StorageFor<T, StorageTraits<T>::mode>::type>::type;
+
+// lays a storage out in the given entity order where it can (only dense storage moves components)
+template <typename T> inline void reorderStorage(ComponentVector<T>& storage, const vector<ID>& order) { storage.reorder(order); }
+template <typename S> inline void reorderStorage(S&, const vector<ID>&) {}
+// pointer to a component for caching, without flagging a double buffered one as written
+template <typename T> inline T* peekComponent(BufferedVector<T>& storage, ID entityID) { return storage.peek(entityID); }
+template <typename S> inline auto peekComponent(S& storage, ID entityID) { return &storage.getComponent(entityID); }
+// flags a component written through a cached pointer (only double buffered storage needs to know)
+template <typename T> inline void markWritten(BufferedVector<T>& storage, ID entityID) { storage.markDirty(entityID); }
+template <typename S> inline void markWritten(S&, ID) {}
+
 // manages component vectors and tosses around pointers like it's nothing
 class ComponentManager {
     private:
         map<const char*, std::shared_ptr<IComponentVector>> componentVectors;
+        // double buffered storages, the only ones swapBuffers has to visit
+        vector<IComponentVector*> bufferedVectors;
+        // where mapped component columns are created (empty until setMappedDirectory, which means ".")
+        string mappedDirectory;
+        // keeps this world's default column files apart from other worlds' (process id and a serial)
+        string mappedTag;
     public:
+        inline void swapBuffers();
+        void setMappedDirectory(const string& directory) { mappedDirectory = directory; };
+        // file a mapped component type is stored in
+        template <typename T> inline string mappedPath();
         template <typename T> void addComponent(ID entityID, T component);
+        template <typename T> inline void addComponents(const vector<ID>& entityIDs, const T& component);
+        template <typename T> inline void addComponents(const vector<ID>& entityIDs, const vector<T>& values);
         template <typename T> inline set<ID>& getComponentEntities();
         template <typename T> inline set<ID>& getNewComponentEntities();
         template <typename T> inline void groupEntities();
         template <typename T> inline T& getComponent(ID entityID);
-        template <typename T> std::shared_ptr<ComponentVector<T>> getComponentVector();
+        template <typename T> inline bool hasComponent(ID entityID);
+        template <typename T> inline void removeComponent(ID entityID);
+        template <typename T> std::shared_ptr<ComponentStorage<T>> getComponentVector();
         inline void removeEntity(ID entityID);
+        // removes a batch of entities, visiting each storage once and only for entities whose signature has its bit
+        inline void removeEntities(const vector<ID>& entityIDs, const vector<Signature>& signatures);
+        inline void extractEntity(ID entityID, EntityPacket& packet);
+        inline void memoryStats(MemoryStats& stats);
+        inline string checkInvariants(const map<ID, Entity>& liveEntities, const vector<Signature>& signatures);
+};
+
+// lets the manager keep every query up to date without knowing its component types
+class IQuery {
+    public:
+        virtual ~IQuery() = default;
+        // re-checks an entity after it gained one of the query's components
+        virtual void componentAdded(ID entityID)=0;
+        // drops an entity from the results (does nothing if it wasn't a match)
+        // also used when the entity loses one of the query's components
+        virtual void entityRemoved(ID entityID)=0;
+        // re-checks an entity after it was enabled or disabled
+        virtual void entityChanged(ID entityID)=0;
+};
+
+// dense list of matching entities with O(1) insert and removal
+class QueryBase : public IQuery {
+    protected:
+        // matching entities, packed
+        vector<ID> matches;
+        // slot of each entity in matches, indexed by ID (nullEntity if not a match)
+        vector<unsigned> positions;
+        inline bool contains(ID entityID) const;
+        inline void insert(ID entityID);
+        inline void erase(ID entityID);
+    public:
+        inline void entityRemoved(ID entityID) override;
+        // matching entities (order changes as entities come and go)
+        const vector<ID>& entities() const { return matches; };
+        size_t size() const { return matches.size(); };
+        vector<ID>::const_iterator begin() const { return matches.begin(); };
+        vector<ID>::const_iterator end() const { return matches.end(); };
+};
+
+// persistent query for entities having every component in Ts, registered with ECSManager::query
+// membership is updated as components are added or removed, entities destroyed and entities enabled or
+// disabled, so iterating costs O(matches)
+// (don't destroy or add entities while iterating, go through ECSManager::defer instead)
+template <typename... Ts>
+class Query : public QueryBase {
+    private:
+        // storages the components come from
+        std::tuple<std::shared_ptr<ComponentStorage<Ts>>...> storages;
+        // the manager's entity signatures, the bits a match needs and the bits it must not have
+        const vector<Signature>& signatures;
+        Signature mask;
+        Signature excluded;
+    public:
+        inline Query(ComponentManager& components, const vector<Signature>& signatures, bool includeDisabled);
+        // checks if an entity has every component in Ts (and is enabled, unless disabled ones are included)
+        inline bool isMatch(ID entityID);
+        inline void componentAdded(ID entityID) override;
+        inline void entityChanged(ID entityID) override;
+        // calls f(id, Ts&...) for every match
+        template <typename F> inline void each(F f);
+};
+
+// cache key that keeps queryIncludingDisabled apart from query over the same components
+template <typename... Ts> struct DisabledQueryKey {};
+
+// getComponentEntities set with disabled entities left out, kept up to date through the same
+// notifications as cached queries so reading it never rebuilds anything
+template <typename T>
+class EnabledEntitySet : public IQuery {
+    private:
+        std::shared_ptr<ComponentStorage<T>> storage;
+        const vector<Signature>& signatures;
+        set<ID> members;
+    public:
+        inline EnabledEntitySet(ComponentManager& components, const vector<Signature>& signatures);
+        // adds an enabled entity once it is in the storage's own set (grouped, not still new)
+        inline void componentAdded(ID entityID) override;
+        inline void entityRemoved(ID entityID) override;
+        inline void entityChanged(ID entityID) override;
+        // picks up the storage's new entities just before groupEntities moves them over
+        inline void grouping(const set<ID>& newEntities);
+        set<ID>& entities() { return members; };
+};
+
+// tells a spatial index where a component sits, specialize for position types without x/y members
+template <typename T>
+struct SpatialTraits {
+    static float x(const T& component) { return component.x; }
+    static float y(const T& component) { return component.y; }
+};
+
+// lets the manager notify every spatial index without knowing its component type
+class ISpatialIndex {
+    public:
+        // queues an entity to be re-read at the next flush
+        virtual void entityChanged(ID entityID)=0;
+        // drops an entity from the grid straight away
+        virtual void entityRemoved(ID entityID)=0;
+        // applies all queued changes
+        virtual void flush()=0;
+};
+
+// uniform hash grid over one position component type
+// only re-reads entities that were flagged as changed, and only when flushed (end of ECSManager::update)
+template <typename T>
+class SpatialIndex : public ISpatialIndex {
+    private:
+        // where an entity currently sits in the grid
+        struct Entry {
+            float x;
+            float y;
+            uint64_t cell;
+            // position inside the cell's id list
+            unsigned slot;
+            bool present = false;
+            bool queued = false;
+        };
+        // storage the positions are read from
+        std::shared_ptr<ComponentStorage<T>> storage;
+        // the manager's entity signatures, to leave disabled entities out of queries
+        const vector<Signature>& signatures;
+        float cellSize;
+        float inverseCellSize;
+        // id lists per occupied cell
+        std::unordered_map<uint64_t, vector<ID>> cells;
+        // per-entity grid entries, indexed by ID
+        vector<Entry> entries;
+        // number of entities in the grid
+        size_t count = 0;
+        // entities waiting to be re-read
+        vector<ID> pending;
+        // reusable scratch space for nearestK
+        vector<std::pair<float, ID>> candidates;
+        // converts a coordinate to a cell coordinate
+        inline int32_t cellCoord(float value) const;
+        // packs two cell coordinates into a key
+        static inline uint64_t cellKey(int32_t cellX, int32_t cellY);
+        // takes an entity out of its cell
+        inline void removeFromCell(ID entityID, Entry& entry);
+        // grows entries to cover an id
+        inline Entry& getEntry(ID entityID);
+        // whether a query should report an entity
+        bool visible(ID entityID, bool includeDisabled) const { return includeDisabled || !signatures[entityID].test(disabledBit); };
+    public:
+        inline SpatialIndex(std::shared_ptr<ComponentStorage<T>> storage, const vector<Signature>& signatures, float cellSize);
+        inline void entityChanged(ID entityID) override;
+        inline void entityRemoved(ID entityID) override;
+        inline void flush() override;
+        // disabled entities stay in the grid but are skipped by the queries below unless includeDisabled is set
+        // fills out with every entity inside the box (edges included), returns how many were found
+        inline size_t queryAABB(float minX, float minY, float maxX, float maxY, vector<ID>& out, bool includeDisabled = false);
+        // fills out with every entity within radius of a point, returns how many were found
+        inline size_t queryRadius(float x, float y, float radius, vector<ID>& out, bool includeDisabled = false);
+        // fills out with the k entities closest to a point, nearest first, returns how many were found
+        inline size_t nearestK(float x, float y, size_t k, vector<ID>& out, bool includeDisabled = false);
+};
+
+// type-erased component value held by a prefab
+class IPrefabComponent {
+    public:
+        virtual ~IPrefabComponent() = default;
+        // copies the value onto every entity in one bulk insert
+        virtual void instantiate(ECSManager& manager, const vector<ID>& entityIDs)=0;
+        // writes the value back over a recycled entity's component
+        virtual void reset(ECSManager& manager, ID entityID)=0;
+};
+
+template <typename T>
+class PrefabComponent : public IPrefabComponent {
+    private:
+        T component;
+    public:
+        PrefabComponent(T component) : component(component) {};
+        inline void instantiate(ECSManager& manager, const vector<ID>& entityIDs) override;
+        inline void reset(ECSManager& manager, ID entityID) override;
+};
+
+// named, pre-built set of component values that can be stamped onto new entities in bulk
+class Prefab {
+    private:
+        // one entry per component type
+        vector<unique_ptr<IPrefabComponent>> components;
+        // released instances, disabled with their components still in place (see ECSManager::poolPrefab)
+        vector<ID> pool;
+        bool pooled = false;
+        friend class ECSManager;
+    public:
+        // name the prefab was registered under
+        string name;
+        Prefab(string name) : name(name) {};
+        // adds a component value every instance starts with
+        template <typename T> inline Prefab& add(T component);
 };
 
 // note: for the systems there are two of each function
@@ -107,6 +888,8 @@ class ComponentManager {
 class System {
     private:
     public:
+        // systems are owned through base pointers, subclasses (like AsyncSystem) need their destructors run
+        virtual ~System() = default;
         virtual void init() {};
         virtual void init(ECSManager* manager) { init(); };
         virtual void update() {};
@@ -121,45 +904,602 @@ class RenderSystem : public System {
         virtual void render(ECSManager* manager) { render(); };
 };
 
+#ifdef ECPPS_COROUTINES
+// coroutine run by the manager's scheduler (async systems and entity behaviours)
+// starts suspended, and is resumed by the manager whenever whatever it awaits is ready
+class Task {
+    public:
+        struct promise_type {
+            // exception thrown out of the coroutine, rethrown by whoever owns the task
+            std::exception_ptr exception;
+            Task get_return_object() { return Task(std::coroutine_handle<promise_type>::from_promise(*this)); };
+            std::suspend_always initial_suspend() noexcept { return {}; };
+            std::suspend_always final_suspend() noexcept { return {}; };
+            void return_void() {};
+            void unhandled_exception() { exception = std::current_exception(); };
+        };
+        Task() {};
+        Task(Task&& other) noexcept : handle(other.handle) { other.handle = nullptr; };
+        inline Task& operator=(Task&& other) noexcept;
+        Task(const Task&) = delete;
+        Task& operator=(const Task&) = delete;
+        inline ~Task();
+        // whether there is a coroutine that hasn't finished yet
+        inline bool running() const;
+        // runs the coroutine until it next suspends
+        inline void resume();
+        // rethrows anything the finished coroutine threw
+        inline void rethrow() const;
+    private:
+        std::coroutine_handle<promise_type> handle;
+        explicit Task(std::coroutine_handle<promise_type> handle) : handle(handle) {};
+};
+
+// base class for systems whose work spans several frames
+// run() is a coroutine that can co_await manager->nextFrame() or manager->runInBackground(job),
+// it is restarted on the next update after it finishes
+class AsyncSystem : public System {
+    private:
+        Task task;
+    public:
+        virtual Task run(ECSManager* manager)=0;
+        inline void update(ECSManager* manager) override;
+};
+
+// awaited to pause a coroutine until the next update
+struct NextFrame {
+    ECSManager& manager;
+    bool await_ready() const noexcept { return false; };
+    inline void await_suspend(std::coroutine_handle<> handle);
+    void await_resume() const noexcept {};
+};
+
+// small set of worker threads that runs one manager's background jobs
+// workers are started as jobs arrive (up to maxThreads) and joined when the pool is destroyed,
+// jobs still queued at that point are dropped
+class JobPool {
+    public:
+        explicit JobPool(unsigned maxThreads) : maxThreads(maxThreads) {};
+        inline ~JobPool();
+        JobPool(const JobPool&) = delete;
+        JobPool& operator=(const JobPool&) = delete;
+        // queues a job, starting another worker if none are idle and the limit allows it
+        inline void submit(std::function<void()> job);
+    private:
+        unsigned maxThreads;
+        vector<std::thread> workers;
+        std::queue<std::function<void()>> jobs;
+        std::mutex mutex;
+        std::condition_variable wake;
+        // workers currently waiting for a job
+        unsigned idle = 0;
+        bool stopping = false;
+        // worker loop, runs jobs until the pool is stopped
+        inline void work();
+};
+
+// awaited to run a job on the manager's job pool and pick the coroutine back up (on the main thread) once it's done
+template <typename R>
+struct BackgroundJob {
+    ECSManager& manager;
+    std::function<R()> job;
+    // shared with the manager's waiter, which can outlive this awaiter if the behaviour is destroyed
+    std::shared_ptr<std::future<R>> result;
+    bool await_ready() const noexcept { return false; };
+    inline void await_suspend(std::coroutine_handle<> handle);
+    R await_resume() { return result->get(); };
+};
+
+// awaited to pause a coroutine for some simulated seconds
+struct Wait {
+    ECSManager& manager;
+    double seconds;
+    bool await_ready() const noexcept { return false; };
+    inline void await_suspend(std::coroutine_handle<> handle);
+    void await_resume() const noexcept {};
+};
+
+// per-entity coroutine (e.g. "scatter for 7s then chase"), added with addBehaviour
+// it is owned by the component, so destroying the entity ends it
+struct Behaviour : public Component {
+    // shared so component copies inside the storage don't end the coroutine
+    std::shared_ptr<Task> task;
+    // tells this behaviour apart from later ones on a recycled entity id
+    unsigned long long serial = 0;
+};
+
+// identifies which behaviour (if any) a suspended coroutine belongs to
+struct BehaviourOwner {
+    // nullEntity for coroutines that don't belong to an entity (async systems)
+    ID entity = nullEntity;
+    unsigned long long serial = 0;
+};
+
+// coroutine waiting on a background job
+struct JobWaiter {
+    // returns true once the job has finished
+    std::function<bool()> ready;
+    std::coroutine_handle<> handle;
+    BehaviourOwner owner;
+};
+
+// coroutine sleeping until a point in simulated time
+struct TimedWaiter {
+    double wakeTime;
+    // breaks ties so equal wake times resume in the order they went to sleep
+    unsigned long long order;
+    std::coroutine_handle<> handle;
+    BehaviourOwner owner;
+    // earliest wake time comes out of the priority queue first
+    bool operator>(const TimedWaiter& other) const {
+        return wakeTime != other.wakeTime ? wakeTime > other.wakeTime : order > other.order;
+    };
+};
+#endif
+
+// rolling timing stats for one phase of one system, all times in microseconds
+struct SystemStats {
+    // name of the system
+    string name;
+    // which call was timed ("init", "update" or "render")
+    const char* phase;
+    // total number of sampled calls since profiling was enabled
+    unsigned long long calls = 0;
+    // number of samples currently in the rolling window
+    unsigned samples = 0;
+    double min = 0;
+    double avg = 0;
+    double p99 = 0;
+};
+
+// holds a fixed ring of timing samples so that profiling never allocates per frame
+class SystemProfile {
+    private:
+        // ring of the most recent samples
+        float window[ECPPS_PROFILE_WINDOW];
+        // next slot to write in the ring
+        unsigned next = 0;
+        // number of valid samples in the ring
+        unsigned count = 0;
+        // total number of samples taken
+        unsigned long long calls = 0;
+    public:
+        // which call this profile is timing
+        const char* phase;
+        SystemProfile(const char* phase) : phase(phase) {};
+        // adds a new sample, overwriting the oldest once the window is full
+        inline void addSample(float micros);
+        // computes min/avg/p99 over the current window
+        inline SystemStats getStats() const;
+        // throws away all samples
+        inline void reset();
+};
+
+// one complete ("X" phase) event in the chrome trace_event format
+struct TraceEvent {
+    // index of the system name in the manager's profile name list
+    unsigned name;
+    // which call was timed
+    const char* phase;
+    // start time and duration in microseconds since profiling was enabled
+    double start;
+    double duration;
+};
+
+// per-system timing data, one entry per registered system
+struct SystemTimers {
+    // index of the system name in the manager's profile name list (never changes once registered)
+    unsigned name;
+    SystemProfile init{"init"};
+    SystemProfile update{"update"};
+    SystemProfile render{"render"};
+};
+
+// named points in the frame that systems run in, in this order
+// update() runs the first three, render() runs the last two, and deferred changes are applied after each
+enum class Stage { PreUpdate, Update, PostUpdate, PreRender, Render };
+// number of stages above
+constexpr unsigned stageCount = 5;
+
+// one registered system and where it runs
+struct SystemEntry {
+    unique_ptr<System> system;
+    // same object as system if it is a RenderSystem, otherwise nullptr
+    RenderSystem* renderSystem;
+    Stage stage;
+    // typeIndex of the system class, used by ordering constraints
+    unsigned type;
+    // system types this one has to run before / after (only within the same stage)
+    vector<unsigned> runsBefore;
+    vector<unsigned> runsAfter;
+    SystemTimers timers;
+};
+
+// returned by registerSystem so ordering constraints can be chained on
+class SystemHandle {
+    private:
+        ECSManager& manager;
+        // index of the system in registration order
+        unsigned entry;
+    public:
+        SystemHandle(ECSManager& manager, unsigned entry) : manager(manager), entry(entry) {};
+        // makes this system run before every system of type T in the same stage
+        template <typename T> inline SystemHandle& before();
+        // makes this system run after every system of type T in the same stage
+        template <typename T> inline SystemHandle& after();
+};
+
+// hands out entity ids from any thread without locking
+// freed ids sit on a lock-free (Treiber) stack linked through a slot array, fresh ids come off an atomic counter
+// the slot array grows in chunks that double in size and never move, so links can be read while it grows
+class IDAllocator {
+    private:
+        // ids covered by the first chunk, each later chunk is twice the size of the one before
+        static constexpr size_t firstChunkSize = 1024;
+        static constexpr unsigned chunkCount = 23;
+        // next free id below each free id
+        std::atomic<std::atomic<ID>*> chunks[chunkCount];
+        // top of the free stack, id in the low 32 bits and a change counter above it (stops ABA)
+        std::atomic<uint64_t> freeHead{nullEntity};
+        // first id never handed out
+        std::atomic<ID> nextID{0};
+        // ids on the free stack
+        std::atomic<size_t> freeCount{0};
+        // ids reserved by threads that haven't been turned into entities yet
+        std::atomic<size_t> reservedCount{0};
+        // tells allocators apart in thread local blocks (addresses can be reused)
+        uint64_t serial;
+        // link slot value of a reserved id that hasn't become an entity yet (never handed out as an id)
+        static constexpr ID reservedLink = nullEntity - 1;
+        // live allocators by serial, so a thread that exits can hand back ids it reserved but never used
+        struct Registry {
+            std::mutex mutex;
+            map<uint64_t, IDAllocator*> live;
+        };
+        static inline Registry& registry();
+        // ids one thread has reserved from one allocator and not handed out yet
+        struct ReservedBlock {
+            uint64_t owner;
+            ID next;
+            ID end;
+        };
+        // every block a thread holds (one per allocator), handed back when the thread exits
+        struct ThreadBlocks {
+            vector<ReservedBlock> blocks;
+            inline ~ThreadBlocks();
+        };
+        // gets the link slot of an id, allocating its chunk the first time
+        inline std::atomic<ID>& slot(ID entityID);
+        // takes count fresh ids off the counter, returns the first
+        inline ID takeFresh(ID count);
+        // puts reserved ids that were never handed out on the free stack
+        inline void returnReserved(ID first, ID end);
+    public:
+        inline IDAllocator();
+        IDAllocator(const IDAllocator&) = delete;
+        IDAllocator& operator=(const IDAllocator&) = delete;
+        inline ~IDAllocator();
+        // gets an id, recycled if one is free
+        inline ID allocate();
+        // gets a fresh id from this thread's block for this allocator, nothing shared is touched until the block runs out
+        inline ID reserve();
+        // marks a reserved id as used (it became an entity), false if the id isn't currently reserved
+        inline bool claimReserved(ID entityID);
+        // puts an id back on the free stack
+        inline void release(ID entityID);
+        // ids handed out so far (live, free or reserved)
+        ID issued() const { return nextID.load(std::memory_order_acquire); };
+        size_t freeIDs() const { return freeCount.load(std::memory_order_relaxed); };
+        size_t reservedIDs() const { return reservedCount.load(std::memory_order_relaxed); };
+        // bytes held by the link chunks
+        inline size_t bytes() const;
+        // calls f(id) for every free id, only while no other thread is allocating
+        template <typename F> inline void forEachFree(F f);
+};
+
+// node in a world's queue of commands deferred from other threads
+struct CommandNode {
+    std::function<void(ECSManager&)> command;
+    CommandNode* next;
+};
+
+// node in a world's incoming transfer queue
+struct TransferNode {
+    EntityPacket packet;
+    TransferNode* next;
+};
+
+// one component type's values inside a partition
+struct StagedColumn {
+    // hashName of the type's name, picks the codec that merges it
+    uint64_t typeHash = 0;
+    uint32_t elementSize = 0;
+    // partition index of the entity each value belongs to
+    vector<uint32_t> entities;
+    // raw values, elementSize bytes each
+    vector<unsigned char> bytes;
+};
+
+// a world partition decoded from disk, ready for ECSManager::mergePartition
+// entities are numbered 0 to entityCount - 1 inside the partition, merging maps them onto fresh ids
+struct StagedPartition {
+    uint32_t entityCount = 0;
+    // partition index of each entity's parent (nullEntity for roots)
+    vector<uint32_t> parents;
+    vector<StagedColumn> columns;
+};
+
+// reads and decodes a partition file, touches no manager so it's safe on any thread
+inline StagedPartition readPartition(const string& path);
+
+// saves and merges one streamable component type
+class IStreamCodec {
+    public:
+        virtual ~IStreamCodec() = default;
+        // packs the component of every listed entity that has one, toLocal maps an id to its partition index
+        virtual void save(ECSManager& manager, const vector<ID>& entityIDs, const std::function<ID(ID)>& toLocal, StagedColumn& column)=0;
+        // throws if a column can't be merged into a partition of entityCount entities
+        virtual void validate(const StagedColumn& column, uint32_t entityCount)=0;
+        // adds a column's values to freshly created entities (entityIDs[i] is partition entity i), validate first
+        virtual void merge(ECSManager& manager, const StagedColumn& column, const vector<ID>& entityIDs)=0;
+};
+
+template <typename T>
+class StreamCodec : public IStreamCodec {
+    private:
+        // rewrites entity ids held inside a component (may be empty)
+        std::function<void(T&, const std::function<ID(ID)>&)> remapIDs;
+    public:
+        StreamCodec(std::function<void(T&, const std::function<ID(ID)>&)> remapIDs) : remapIDs(std::move(remapIDs)) {};
+        inline void save(ECSManager& manager, const vector<ID>& entityIDs, const std::function<ID(ID)>& toLocal, StagedColumn& column) override;
+        inline void validate(const StagedColumn& column, uint32_t entityCount) override;
+        inline void merge(ECSManager& manager, const StagedColumn& column, const vector<ID>& entityIDs) override;
+};
+
+// partition being decoded on a loader thread
+struct PendingPartition {
+    string name;
+    std::future<StagedPartition> staged;
+};
+
 // holds much of the top level ECS data and functionality
+// a manager owns all of its state, so separate managers can tick on separate threads
+// (the only things shared between managers are the typeIndex counter, which is atomic, and the
+// id allocators' registry, which threads use to hand back reserved ids when they exit)
 class ECSManager {
     private:
         // holds the id for this manager
         ID managerID;
-        // holds all systems for looping through updates
-        vector<unique_ptr<System>> systems;
-        // holds all render systems for looping through renders
-        vector<unique_ptr<RenderSystem>> rsystems;
+        // holds all systems in registration order
+        vector<SystemEntry> systems;
+        // systems flattened into execution order, grouped by stage
+        vector<SystemEntry*> schedule;
+        // where each stage starts in schedule (stageCount + 1 entries)
+        unsigned stageStart[stageCount + 1] = {};
+        // set when systems or constraints change so the schedule gets rebuilt before the next run
+        bool scheduleChanged = false;
+        // sorts systems into schedule, honouring stage order and before/after constraints
+        inline void buildSchedule();
+        // structural changes queued by systems, applied at the end of each stage
+        vector<std::function<void(ECSManager&)>> deferred;
+#ifdef ECPPS_COROUTINES
+        // coroutines waiting for the next update
+        vector<std::coroutine_handle<>> frameWaiters;
+        // coroutines waiting on background jobs
+        vector<JobWaiter> jobWaiters;
+        // runs background jobs, created on the first one so worlds that never use it start no threads
+        std::unique_ptr<JobPool> jobPool;
+        // most worker threads a manager's job pool will start
+        static constexpr unsigned maxJobThreads = 4;
+        // coroutines sleeping, earliest wake time on top
+        std::priority_queue<TimedWaiter, vector<TimedWaiter>, std::greater<TimedWaiter>> timedWaiters;
+        unsigned long long nextWaiterOrder = 0;
+        // behaviour currently being resumed, so awaiters know who is suspending
+        BehaviourOwner currentBehaviour;
+        // counts behaviours to give each a unique serial
+        unsigned long long behaviourSerial = 0;
+        // resumes every coroutine that is ready to continue
+        inline void resumeCoroutines();
+        // queues a coroutine to wake after some simulated seconds
+        inline void sleepCoroutine(double seconds, std::coroutine_handle<> handle);
+        // whether a coroutine's behaviour (and so its frame) still exists
+        inline bool ownerAlive(BehaviourOwner owner);
+        // resumes a coroutine if its behaviour still exists, on behalf of that behaviour
+        inline void resumeOwned(std::coroutine_handle<> handle, BehaviourOwner owner);
+        friend struct NextFrame;
+        friend struct Wait;
+        template <typename R> friend struct BackgroundJob;
+#endif
+        friend class SystemHandle;
         // holds all component vectors
         ComponentManager components;
         // holds all Entity class objects (must be kept around until ready to delete)
         map<ID, Entity> entities;
-        // holds special entities, obtainable by name
-        map<string, ID&> specialEntities;
-        // holds current value to generate new entityIDs
-        ID nextID = 0;
-        // holds all IDs that once belonged to entities that have been deleted (reusable)
-        vector<ID> reusableIDs;
+        // holds special entities by name hash, open addressed with a power of two size
+        vector<SpecialEntitySlot> specialEntities;
+        // number of slots that have ever been used (removed names keep their slot)
+        unsigned usedSpecialSlots = 0;
+        // number of names currently holding an entity
+        unsigned specialEntityCount = 0;
+        // finds the slot for a name, or the empty slot it would go in
+        inline SpecialEntitySlot& findSpecialSlot(uint64_t hash);
+        // hands out entity ids, recycling those of destroyed entities (thread safe)
+        IDAllocator idAllocator;
+        // commands deferred from other threads, pushed lock-free (newest first)
+        std::atomic<CommandNode*> concurrentCommands{nullptr};
+        // which components each entity has, indexed by ID (all zero for unused IDs)
+        vector<Signature> signatures;
+        // sets up the signature for a new entity
+        inline void createSignature(ID entityID);
         // creates a unique ID for each enitity
         inline ID generateEntityID();
+        // creates an entity under an id that's already been handed out
+        template <typename T, typename... Args> inline Entity& createEntityWithID(ID newID, Args... args);
+        // names of all registered systems, only ever appended to so trace events can refer to them by index
+        vector<string> profileNames;
+        // whether profiling is turned on at all
+        bool profiling = false;
+        // whether the current frame is being sampled
+        bool sampling = false;
+        // only every nth frame is sampled (1 samples every frame)
+        unsigned sampleRate = 1;
+        // counts frames to decide when to sample
+        unsigned long long profileFrame = 0;
+        // time all timestamps are relative to
+        std::chrono::steady_clock::time_point profileStart;
+        // ring of trace events for export, empty if tracing is off
+        vector<TraceEvent> traceEvents;
+        // next slot to write in the trace ring
+        size_t nextTraceEvent = 0;
+        // whether the trace ring has wrapped around
+        bool traceWrapped = false;
+        // runs a system call and records its timing if the frame is being sampled
+        template <typename F> inline void timeSystem(const SystemTimers& timers, SystemProfile& profile, F call);
+        // every entity in the hierarchy, sorted so parents always come before their children
+        vector<HierarchyNode> hierarchyOrder;
+        // set when links change so the order gets rebuilt before the next propagation
+        bool hierarchyChanged = false;
+        // hierarchy storage layout the links pointers in hierarchyOrder were taken from
+        uint64_t hierarchyLayout = 0;
+        // bumped on every rebuild, so cached transform slots know the order moved
+        uint64_t hierarchyOrderVersion = 0;
+        // cached TransformSlots, one slot per type index (empty until that pair is propagated)
+        vector<std::shared_ptr<void>> transformSlots;
+        // unlinks an entity from its parent's child list
+        inline void detachFromParent(Hierarchy& node);
+        // drops everything outside the component storages that refers to an entity being destroyed
+        // (names, pools, partitions, spatial indexes, cached queries)
+        inline void unlinkEntity(ID entityID);
+        // fixes up depth for an entity and everything below it
+        inline void updateDepth(ID entityID, unsigned depth);
+        // rebuilds hierarchyOrder from the hierarchy components
+        inline void rebuildHierarchyOrder();
+        // holds spatial indexes by the component type they index
+        map<const char*, std::shared_ptr<ISpatialIndex>> spatialIndexes;
+        // holds registered prefabs by name
+        map<string, Prefab> prefabs;
+        // prefab each pooled entity came from, indexed by ID (nullptr if not pooled)
+        vector<Prefab*> poolOwners;
+        // whether an entity is currently parked in its prefab's pool, indexed by ID
+        vector<bool> parked;
+        // readies a pooled entity for reuse
+        inline void resetInstance(Prefab& prefab, ID entityID);
+        // number of live entities that are disabled
+        size_t disabledCount = 0;
+        // gets (creating on first use) the filtered set getComponentEntities hands out while anything is disabled
+        template <typename T> inline EnabledEntitySet<T>& enabledEntitySet();
+        // holds world-global resources, one slot per type index (empty if not inserted)
+        vector<std::shared_ptr<void>> resources;
+        // cached queries (and filtered entity sets) by typeIndex of their type (nullptr where not created)
+        vector<unique_ptr<IQuery>> queries;
+        // queries to re-check when a component of a type is added, indexed by component typeIndex
+        vector<vector<IQuery*>> queriesByComponent;
+        // every query, for removing destroyed entities
+        vector<IQuery*> allQueries;
+        // tells queries interested in T that an entity gained one
+        template <typename T> inline void notifyQueries(ID entityID);
+        // drops an entity that lost T from every query looking at T
+        template <typename T> inline void notifyQueriesRemoved(ID entityID);
+        // builds or fetches a cached query stored under slot
+        template <typename... Ts> inline Query<Ts...>& cachedQuery(unsigned slot, bool includeDisabled);
+        // entities sent from other worlds, pushed lock-free from any thread (newest first)
+        std::atomic<TransferNode*> inbox{nullptr};
+        // codecs for streamable component types, by hashName of the type name
+        map<uint64_t, unique_ptr<IStreamCodec>> streamCodecs;
+        // partitions still being decoded in the background
+        vector<PendingPartition> pendingPartitions;
+        // ids of each loaded partition's entities, by partition name
+        map<string, vector<ID>> partitions;
+        // partition each entity was loaded with, indexed by ID (nullptr if none)
+        vector<const string*> partitionOwners;
+        // seconds of simulation per update when driven by tick
+        double fixedDeltaTime = 1.0 / 60.0;
+        // most updates a single tick may run before it drops the backlog
+        unsigned maxStepsPerTick = 5;
+        // real time not yet simulated
+        double accumulator = 0;
+        // how far between the last two updates the current render is (0 to 1)
+        double alpha = 0;
+        // total seconds simulated (every update advances it by one fixed step)
+        double simulationTime = 0;
+        // when tick() last ran, for measuring real time
+        std::chrono::steady_clock::time_point lastTick;
+        bool hasTicked = false;
     public:
         inline ECSManager(); 
+        inline ~ECSManager();
+        ECSManager(const ECSManager&) = delete;
+        ECSManager& operator=(const ECSManager&) = delete;
         // creates a default entity
         inline Entity& createEntity();
         // creates an entity of T subclass
         template <typename T, typename... Args> inline Entity& createEntity(Args... args);
         // destroys an entity
         inline void destroyEntity(ID entityID);
-        // used to save unique entity in map
-        inline void setSpecialEntity(string entityName, Entity& entity);
+        // destroys many entities (and their children) in one batch, each storage is visited once
+        inline void destroyEntities(const vector<ID>& entityIDs);
+        // removes an entity from this world and packs up all of its components
+        // (hierarchy links and special names stay behind, children become roots)
+        inline EntityPacket extractEntity(ID entityID);
+        // creates an entity from a packed up one, returns its new id
+        inline ID insertEntity(EntityPacket packet);
+        // moves an entity into another world through that world's queue, safe to call while it ticks on another thread
+        // (it appears there at the start of its next update)
+        inline void sendEntity(ID entityID, ECSManager& destination);
+        // adds every entity sent to this world so far, returns their new ids (called at the start of update)
+        inline vector<ID> receiveEntities();
+        // marks T as saved with partitions (T must be trivially copyable, other components are skipped)
+        // remapIDs(component, remap) rewrites any entity ids T holds, it runs on save and again on merge
+        template <typename T> inline void registerStreamable(std::function<void(T&, const std::function<ID(ID)>&)> remapIDs = nullptr);
+        // writes entities (their streamable components, and hierarchy links inside the group) to a partition file
+        inline void savePartition(const string& path, const vector<ID>& entityIDs);
+        // starts decoding a partition file on a loader thread, it's merged at the start of a later update
+        inline void streamPartition(const string& name, const string& path);
+        // merges every streamed partition that has finished decoding, returns how many (called at the start of update)
+        inline size_t mergeStreamedPartitions();
+        // adds a decoded partition in one go, remapping its entities onto fresh ids, returns the new ids
+        inline const vector<ID>& mergePartition(const string& name, const StagedPartition& staged);
+        // destroys every entity that was loaded with a partition, in one batch
+        inline void unloadPartition(const string& name);
+        inline bool isPartitionLoaded(const string& name);
+        // used to save unique entity by name (cleared automatically when the entity is destroyed)
+        inline void setSpecialEntity(EntityName entityName, Entity& entity);
+        inline void setSpecialEntity(EntityName entityName, ID entityID);
         // used to retreive unique entity
-        inline ID& getSpecialEntity(string entityName);
+        inline ID getSpecialEntity(EntityName entityName);
+        // checks if a name currently holds an entity
+        inline bool hasSpecialEntity(EntityName entityName);
+        // forgets a name
+        inline void removeSpecialEntity(EntityName entityName);
         // adds a component of any type to a database of T (subclass of component)
         template <typename T> inline void addComponent(ID entityID, T component);
         // adds a component of any type to a database of T (subclass of component) and entityID of ECSmanager
         template <typename T> inline void addComponent(T component);
-        // gets a set of all relevant entities per component
-        template <typename T> inline set<ID>& getComponentEntities();
+        // adds the same component value to many entities with one bulk insert
+        template <typename T> inline void addComponents(const vector<ID>& entityIDs, const T& component);
+        // adds values[i] to entityIDs[i] with one bulk insert (both the same length)
+        template <typename T> inline void addComponents(const vector<ID>& entityIDs, const vector<T>& values);
+        // registers a new, empty prefab under a name (replacing any old one)
+        inline Prefab& createPrefab(string prefabName);
+        // gets a registered prefab
+        inline Prefab& getPrefab(const string& prefabName);
+        // creates count entities carrying copies of the prefab's components, then runs customize(id, instance) on each
+        // (pooled prefabs hand out released instances first, reset to the prefab values)
+        inline vector<ID> instantiate(Prefab& prefab, unsigned count,
+            const std::function<void(ID, unsigned)>& customize = nullptr);
+        inline vector<ID> instantiate(const string& prefabName, unsigned count,
+            const std::function<void(ID, unsigned)>& customize = nullptr);
+        // turns on pooling for a prefab and parks prewarm ready-made instances in its pool
+        inline void poolPrefab(const string& prefabName, unsigned prewarm = 0);
+        // creates one instance, reusing a released one if the prefab is pooled (no allocation once warm)
+        inline ID spawn(Prefab& prefab);
+        // hands a pooled entity back to its prefab's pool (disabled, components kept), destroys anything else
+        // (releasing an entity that is already parked throws)
+        // (only the prefab's own components are reset on reuse, remove any extras before releasing)
+        inline void release(ID entityID);
+        // gets a set of all relevant entities per component, leaving out disabled ones unless includeDisabled is set
+        // (the filtered set is built on first use and kept up to date like a cached query)
+        template <typename T> inline set<ID>& getComponentEntities(bool includeDisabled = false);
         // gets a set of all entity/components ready to init
         template <typename T> inline set<ID>& getNewComponentEntities();
         // used to move init components back into regular pool
@@ -167,15 +1507,139 @@ class ECSManager {
         // gets a component of type and entity
         template <typename T> inline T& getComponent(ID entityID);
         // gets a component of any type and entityID of ECSmanager itself
+        // (prefer resources for world-global data, they skip the component lookup)
         template <typename T> inline T& getComponent();
-        // registers a new system
-        template <typename T> inline void registerSystem();
+        // stores a world-global value of type T, replacing any existing one
+        template <typename T> inline T& insertResource(T resource);
+        // gets the world-global value of type T
+        template <typename T> inline T& resource();
+        // checks if a world-global value of type T exists
+        template <typename T> inline bool hasResource();
+        // deletes the world-global value of type T
+        template <typename T> inline void removeResource();
+        // checks if an entity has a component of type
+        template <typename T> inline bool hasComponent(ID entityID);
+        // gets (creating on first use) the cached query for entities with every component in Ts
+        template <typename... Ts> inline Query<Ts...>& query();
+        // same as query, but disabled entities stay in the results
+        template <typename... Ts> inline Query<Ts...>& queryIncludingDisabled();
+        // sets where mapped component columns are created (before any mapped component is used)
+        // by default they go in the working directory under names unique to this world and are deleted with it,
+        // an explicit directory gets plain <Type>.column names, and only one world can write there at a time
+        inline void setMappedDirectory(const string& directory);
+        // calls f(id, component) for every entity with a data component T, straight off the storage
+        // (disabled entities are skipped unless includeDisabled is set)
+        template <typename T, typename F> inline void forEachComponent(F f, bool includeDisabled = false);
+        // gets the storage for a data component, for tight loops over storage<T>().data()
+        // (or forEachPage() for paged components)
+        // its spans include disabled entities, use forEachComponent for a loop that skips them
+        template <typename T> inline ComponentStorage<T>& storage();
+        // gets an entity's component signature
+        inline const Signature& getSignature(ID entityID);
+        // fills out with every live entity whose signature has all of the bits of all and none of none
+        // (one vectorized pass over the signature array), returns how many were found
+        inline size_t matchSignatures(const Signature& all, const Signature& none, vector<ID>& out);
+        // fills out with every live entity having all of Ts and none of the components in without
+        // (disabled entities are skipped unless includeDisabled is set)
+        template <typename... Ts> inline size_t findEntities(vector<ID>& out, const Signature& without = Signature(), bool includeDisabled = false);
+        // hides an entity from queries and findEntities without touching its components
+        inline void disable(ID entityID);
+        // brings a disabled entity back
+        inline void enable(ID entityID);
+        inline bool isEnabled(ID entityID);
+        // attaches child to parent (nullEntity detaches it and makes it a root), keeping depth order up to date
+        inline void setParent(ID child, ID parent);
+        // gets an entity's parent, or nullEntity if it has none
+        inline ID getParent(ID entityID);
+        // gets an entity's direct children
+        inline vector<ID> getChildren(ID entityID);
+        // flags an entity's transform as changed so the next propagation visits it and its subtree
+        inline void markTransformDirty(ID entityID);
+        // computes World for every hierarchy entity with Local and World in one pass, parents first
+        // combine(const World* parentWorld, const Local& local) returns the new world value
+        // (parentWorld is nullptr for roots), clean subtrees are skipped
+        template <typename Local, typename World, typename F> inline void propagateTransforms(F combine);
+        // builds a hash grid over every entity with T, kept up to date from then on
+        template <typename T> inline SpatialIndex<T>& createSpatialIndex(float cellSize);
+        // gets the hash grid built over T
+        template <typename T> inline SpatialIndex<T>& getSpatialIndex();
+        // flags a component as modified so anything derived from it (like a spatial index or a double buffer) picks it up
+        template <typename T> inline void markChanged(ID entityID);
+        // applies queued spatial index changes now instead of waiting for the end of update
+        inline void flushSpatialIndexes();
+        // publishes this frame's double buffered component writes to readers, call once per frame
+        // at the sync point between update and handing the frame to a render thread
+        inline void swapBuffers();
+        // gets the front (last swapped) copy of a double buffered component
+        // (the storage lookup isn't thread safe if new component types are still being created,
+        // a render thread can hold on to storage<T>() and call read on it instead)
+        template <typename T> inline const T& readComponent(ID entityID);
+        // registers a new system in the Update stage (Render for render systems)
+        template <typename T> inline SystemHandle registerSystem();
+        // registers a new system in a specific stage
+        template <typename T> inline SystemHandle registerSystem(Stage stage);
+        // removes component T from an entity (does nothing if it doesn't have one)
+        template <typename T> inline void removeComponent(ID entityID);
+        // removes every component in Ts from an entity
+        template <typename... Ts> inline void removeComponents(ID entityID);
+        // queues removeComponents to run with the other deferred changes (safe while iterating a query)
+        template <typename... Ts> inline void deferRemoveComponents(ID entityID);
+        // queues a change to run at the end of the current stage (safe to add/destroy from inside a system)
+        inline void defer(std::function<void(ECSManager&)> command);
+        // same as defer, but safe to call from any thread while the world updates
+        inline void deferConcurrent(std::function<void(ECSManager&)> command);
+        // reserves an entity id from any thread, the entity itself is made later with createReservedEntity
+        inline ID reserveEntity();
+        // turns a reserved id into an entity (main thread), throws if the id isn't currently reserved
+        inline Entity& createReservedEntity(ID entityID);
+        // reserves an id now and queues a command that creates the entity and runs fill(manager, id) on it
+        // (safe from worker threads, the entity exists after the next flushDeferred)
+        inline ID spawnConcurrent(std::function<void(ECSManager&, ID)> fill);
+        // runs all queued changes now
+        inline void flushDeferred();
+#ifdef ECPPS_COROUTINES
+        // co_await to continue at the start of the next update
+        inline NextFrame nextFrame();
+        // co_await to run job on the manager's job pool (at most maxJobThreads threads), the coroutine gets job's result back on the main thread
+        template <typename F> inline BackgroundJob<std::invoke_result_t<F>> runInBackground(F job);
+        // co_await to sleep for some simulated seconds
+        inline Wait wait(double seconds);
+        // attaches a coroutine to an entity and runs it up to its first co_await
+        // (destroy the entity itself through defer, not from inside its own behaviour)
+        inline void addBehaviour(ID entityID, Task behaviour);
+#endif
         // inits all systems
         inline virtual void init();
         // updates all systems
         inline virtual void update();
         // renders all rendersystems
         inline virtual void render();
+        // sets the fixed step used by tick, and how many steps one tick may run to catch up
+        inline void setFixedTimestep(double deltaTime, unsigned maxSteps = 5);
+        // runs as many fixed updates as frameSeconds of real time calls for (capped), then one render
+        // returns the number of updates run
+        inline unsigned tick(double frameSeconds);
+        // same, measuring real time since the previous tick itself
+        inline unsigned tick();
+        // seconds simulated by each update
+        inline double getDeltaTime() const;
+        // fraction of a step between the previous and current update, for interpolating in render
+        inline double getAlpha() const;
+        // total seconds simulated so far
+        inline double getSimulationTime() const;
+        // turns on per-system timing, sampling every nth frame and keeping up to traceCapacity events for export
+        inline void enableProfiling(unsigned sampleRate = 1, size_t traceCapacity = 0);
+        // turns off per-system timing (collected stats are kept)
+        inline void disableProfiling();
+        // gets rolling min/avg/p99 for every system call that has been sampled
+        inline vector<SystemStats> getSystemStats();
+        // writes the recorded trace events as chrome trace_event json (loadable in perfetto / chrome://tracing)
+        inline void exportTrace(std::ostream& out);
+        // reports memory used per component type plus entity bookkeeping
+        inline MemoryStats memoryStats();
+        // walks every internal structure and returns a description of the first inconsistency found
+        // (empty string if everything agrees), meant for soak tests and debug builds
+        inline string checkInvariants();
 };
 
 // ####### Everything else ####### //
@@ -186,6 +1650,107 @@ class ECSManager {
 
 
 
+// ------- Helpers ------- //
+
+template <typename T>
+string typeName(){
+    // get compiler name for type
+    const char* name = typeid(T).name();
+#if __has_include(<cxxabi.h>)
+    // try to demangle it
+    int status = 0;
+    char* demangled = abi::__cxa_demangle(name, nullptr, nullptr, &status);
+    if(status == 0 && demangled != nullptr){
+        string result(demangled);
+        std::free(demangled);
+        return result;
+    }
+#endif
+    // otherwise fall back to raw name
+    return name;
+}
+
+template <typename V>
+constexpr size_t treeNodeBytes(){
+    // red-black tree nodes hold a colour and three pointers before the value
+    size_t bytes = sizeof(void*) * 4 + sizeof(V);
+    // allocator hands out blocks rounded to max alignment
+    size_t align = alignof(std::max_align_t);
+    return (bytes + align - 1) / align * align;
+}
+
+// shared counter behind typeIndex, only touched the first time each type is seen
+inline unsigned nextTypeIndex(){
+    static std::atomic<unsigned> counter{0};
+    return counter.fetch_add(1);
+}
+
+template <typename T>
+unsigned typeIndex(){
+    // assigned once per type, thread safe through static init
+    static const unsigned index = nextTypeIndex();
+    return index;
+}
+
+// shared counter behind componentBit, starts after the reserved bits
+inline unsigned nextComponentBit(){
+    static std::atomic<unsigned> counter{reservedSignatureBits};
+    unsigned bit = counter.fetch_add(1);
+    if(bit >= signatureWords * 64){
+        throw "error: too many component types, raise ECPPS_MAX_COMPONENTS";
+    }
+    return bit;
+}
+
+unsigned highestBit(uint64_t word){
+#if defined(__GNUC__) || defined(__clang__)
+    return 63 - __builtin_clzll(word);
+#else
+    unsigned bit = 0;
+    while(word >>= 1){
+        bit++;
+    }
+    return bit;
+#endif
+}
+
+template <typename T>
+unsigned componentBit(){
+    // assigned once per component type, thread safe through static init
+    static const unsigned bit = nextComponentBit();
+    return bit;
+}
+
+bool Signature::matches(const Signature& all, const Signature& none) const {
+    // collect any missing or unwanted bits
+    uint64_t miss = 0;
+    for(unsigned word = 0; word < signatureWords; word++){
+        miss |= (words[word] & all.words[word]) ^ all.words[word];
+        miss |= words[word] & none.words[word];
+    }
+    return miss == 0;
+}
+
+template <typename... Ts>
+Signature makeSignature(){
+    Signature signature;
+    (signature.set(componentBit<Ts>()), ...);
+    return signature;
+}
+
+unsigned lowestBit(uint64_t word){
+#if defined(__GNUC__) || defined(__clang__)
+    return __builtin_ctzll(word);
+#else
+    unsigned bit = 0;
+    while((word & 1) == 0){
+        word >>= 1;
+        bit++;
+    }
+    return bit;
+#endif
+}
+
 // ------- Entity ------- //
 
 template <typename T>
@@ -197,7 +1762,7 @@ void Entity::addComponent(T component){
     }
 }
 
-ID Entity::getID(){
+ID Entity::getID() const {
     // return id
     return entityID;
 }
@@ -211,6 +1776,14 @@ void Entity::destroy(){
 
 template <typename T>
 void ComponentVector<T>::addComponent(ID entityID, T component) {
+    // if entity already has this component, just overwrite it
+    // (inserting again would leave an orphaned component in the vector)
+    auto existing = indexes.find(entityID);
+    if(existing != indexes.end()){
+        components[existing->second] = component;
+        return;
+    }
+
     // define index
     unsigned index;
     // if empty
@@ -229,7 +1802,10 @@ void ComponentVector<T>::addComponent(ID entityID, T component) {
     newEntities.emplace(entityID);
     // place component in vector
     components.emplace_back(component);
+    componentIDs.emplace_back(entityID);
+    layoutVersion++;
     
+#ifdef ECPPS_DEBUG
     std::cout << " -------- adding component to id: " << entityID << std::endl;
     std::cout << "typename: " << typeid(T).name() << std::endl;
     std::cout << "current entity: " << entityID << " at index: " << index << std::endl;
@@ -237,42 +1813,184 @@ void ComponentVector<T>::addComponent(ID entityID, T component) {
     for (const auto& [key, value]: indexes) {
         std::cout << "key: " << key << ", value: " << value << std::endl;
     }
+#endif
 }
 
 template <typename T>
-void ComponentVector<T>::removeEntity(ID entityID) {
-    // get index of entity
-    unsigned index = indexes.at(entityID);
+void ComponentVector<T>::addComponents(const ID* entityIDs, size_t count, const T& component) {
+    components.reserve(components.size() + count);
+    // next free slot in the dense vector
+    unsigned index = components.size();
+    for(size_t i = 0; i < count; i++){
+        if(indexes.emplace(entityIDs[i], index).second){
+            // new entity, will be filled in below
+            newEntities.emplace(entityIDs[i]);
+            componentIDs.emplace_back(entityIDs[i]);
+            index++;
+        } else {
+            // already had one, overwrite in place
+            // (an id repeated within this batch points past the end, the fill below covers it)
+            unsigned existing = indexes[entityIDs[i]];
+            if(existing < components.size()){
+                components[existing] = component;
+            }
+        }
+    }
+    // one fill for the whole block (a plain block copy for trivially copyable types)
+    if(index != components.size()){
+        components.insert(components.end(), index - components.size(), component);
+        layoutVersion++;
+    }
+}
+
+template <typename T>
+void ComponentVector<T>::addComponents(const ID* entityIDs, const T* values, size_t count) {
+    components.reserve(components.size() + count);
+    componentIDs.reserve(componentIDs.size() + count);
+    size_t before = components.size();
+    for(size_t i = 0; i < count; i++){
+        auto inserted = indexes.emplace(entityIDs[i], components.size());
+        if(inserted.second){
+            newEntities.emplace(entityIDs[i]);
+            components.emplace_back(values[i]);
+            componentIDs.emplace_back(entityIDs[i]);
+        } else {
+            // already had one (or is repeated in this batch), the later value wins
+            components[inserted.first->second] = values[i];
+        }
+    }
+    if(components.size() != before){
+        layoutVersion++;
+    }
+}
+
+template <typename T>
+void ComponentVector<T>::removeEntity(ID entityID) {
+    // entity may not have this component at all
+    auto found = indexes.find(entityID);
+    if(found == indexes.end()){
+        return;
+    }
+    // get index of entity
+    unsigned index = found->second;
     // remove index from map
-    indexes.erase(entityID);
-    // remove entity from vector
-    components.erase(components.begin() + index);
-    // update all indexes
+    indexes.erase(found);
+    // remove entity from both entity sets
+    entities.erase(entityID);
+    newEntities.erase(entityID);
+#ifdef ECPPS_DEBUG
     std::cout << " -------- removing entity with id: " << entityID << std::endl;
     std::cout << "typename: " << typeid(T).name() << std::endl;
     std::cout << "current entity: " << entityID << " at index: " << index << std::endl;
-    std::cout << "changing all other component indexes" << std::endl;
-    for (const auto& [key, value]: indexes) {
-        std::cout << "key: " << key << ", value: " << value << std::endl;
-        // if stored index of other entity is higher than the index of the deleted entity
-        if(value > index){
-            // then subtract by 1
-            indexes[key] = value - 1;
-            std::cout << "key: " << key << ", new value: " << value << std::endl;
-        } else {
-            std::cout << "retained old value" << std::endl;
+#endif
+    // swap and pop, only the last component moves
+    unsigned last = components.size() - 1;
+    if(index != last){
+        components[index] = std::move(components[last]);
+        componentIDs[index] = componentIDs[last];
+        indexes[componentIDs[index]] = index;
+    }
+    components.pop_back();
+    componentIDs.pop_back();
+    layoutVersion++;
+}
+
+template <typename T>
+unique_ptr<IComponentPacket> ComponentVector<T>::extractEntity(ID entityID) {
+    auto found = indexes.find(entityID);
+    if(found == indexes.end()){
+        return nullptr;
+    }
+    // move component out before removing its slot
+    unique_ptr<IComponentPacket> packet = std::make_unique<ComponentPacket<T>>(std::move(components[found->second]));
+    removeEntity(entityID);
+    return packet;
+}
+
+template <typename T>
+void ComponentVector<T>::reorder(const vector<ID>& order) {
+    vector<T> sorted;
+    vector<ID> sortedIDs;
+    sorted.reserve(components.size());
+    sortedIDs.reserve(components.size());
+    vector<char> taken(components.size(), 0);
+    for(ID entityID : order){
+        auto found = indexes.find(entityID);
+        if(found == indexes.end() || taken[found->second]){
+            continue;
+        }
+        taken[found->second] = 1;
+        sorted.emplace_back(std::move(components[found->second]));
+        sortedIDs.emplace_back(entityID);
+    }
+    for(unsigned index = 0; index < components.size(); index++){
+        if(!taken[index]){
+            sorted.emplace_back(std::move(components[index]));
+            sortedIDs.emplace_back(componentIDs[index]);
         }
     }
+    components.swap(sorted);
+    componentIDs.swap(sortedIDs);
+    for(unsigned index = 0; index < componentIDs.size(); index++){
+        indexes[componentIDs[index]] = index;
+    }
+    layoutVersion++;
 }
 
 template <typename T>
 inline T& ComponentVector<T>::getComponent(ID entityID) {
-    // get index of entity
-    unsigned index = indexes[entityID];
+    // get index of entity (operator[] would insert a bogus index 0 for missing entities)
+    auto found = indexes.find(entityID);
+    if(found == indexes.end()){
+        throw "error: entity does not have component";
+    }
     // return component at index
-    return components.at(index);
+    return components[found->second];
+}
+
+template <typename T>
+bool ComponentVector<T>::hasEntity(ID entityID){
+    return indexes.find(entityID) != indexes.end();
 }
 
+template <typename T>
+string ComponentVector<T>::checkInvariants(const std::function<bool(ID)>& isLive){
+    string name = typeName<T>();
+    // one index per component
+    if(indexes.size() != components.size() || componentIDs.size() != components.size()){
+        return name + ": " + std::to_string(indexes.size()) + " indexes and " + std::to_string(componentIDs.size()) + " ids for " + std::to_string(components.size()) + " components";
+    }
+    // every index points into the vector and no two entities share one
+    vector<bool> used(components.size(), false);
+    for(const auto& [key, value] : indexes){
+        if(value >= components.size()){
+            return name + ": entity " + std::to_string(key) + " has index " + std::to_string(value) + " past the end";
+        }
+        if(used[value]){
+            return name + ": index " + std::to_string(value) + " is shared by more than one entity";
+        }
+        used[value] = true;
+        // dense id list agrees with the index
+        if(componentIDs[value] != key){
+            return name + ": slot " + std::to_string(value) + " belongs to entity " + std::to_string(key) + " but lists " + std::to_string(componentIDs[value]);
+        }
+        // no component outlives its entity
+        if(!isLive(key)){
+            return name + ": entity " + std::to_string(key) + " was destroyed but still has a component";
+        }
+        // every indexed entity is in exactly one of the two sets
+        bool grouped = entities.count(key) != 0;
+        bool fresh = newEntities.count(key) != 0;
+        if(grouped == fresh){
+            return name + ": entity " + std::to_string(key) + (grouped ? " is in both entity sets" : " is in neither entity set");
+        }
+    }
+    // and the sets hold nothing else
+    if(entities.size() + newEntities.size() != indexes.size()){
+        return name + ": entity sets hold entities without components";
+    }
+    return "";
+}
 template <typename T>
 set<ID>& ComponentVector<T>::getComponentEntities(){
     return entities;
@@ -292,236 +2010,3715 @@ void ComponentVector<T>::groupEntities(){
 }
 
 template <typename T>
-std::shared_ptr<ComponentVector<T>> ComponentManager::getComponentVector(){
-    // first, get type_info to check
-    const char* typekey = typeid(T).name();
+ComponentMemoryStats ComponentVector<T>::memoryStats(){
+    ComponentMemoryStats stats;
+    stats.name = typeName<T>();
+    stats.count = components.size();
+    stats.capacity = components.capacity();
+    stats.denseBytes = components.capacity() * sizeof(T);
+    stats.slackBytes = (components.capacity() - components.size()) * sizeof(T);
+    // every map/set entry is its own heap node
+    stats.indexBytes = indexes.size() * treeNodeBytes<std::pair<const ID, unsigned>>()
+        + (entities.size() + newEntities.size()) * treeNodeBytes<ID>()
+        + componentIDs.capacity() * sizeof(ID);
+    return stats;
+}
 
-    // check if map entry exists
-    if(componentVectors.find(typekey) == componentVectors.end()){
-        //if not, create one
-        componentVectors.insert({typekey, std::make_shared<ComponentVector<T>>()});
+template <typename T>
+void TagVector<T>::addComponent(ID entityID, T /*component*/){
+    // grow to cover the id
+    size_t word = entityID / 64;
+    if(word >= bits.size()){
+        bits.resize(word + 1, 0);
     }
+    uint64_t mask = uint64_t(1) << (entityID % 64);
+    // only count it if it wasn't already tagged
+    if((bits[word] & mask) == 0){
+        bits[word] |= mask;
+        count++;
+        entitySetStale = true;
+    }
+}
 
-    // return pointer for component vector
-    return std::static_pointer_cast<ComponentVector<T>>(componentVectors.at(typekey));
+template <typename T>
+void TagVector<T>::addComponents(const ID* entityIDs, size_t count, const T& component){
+    for(size_t i = 0; i < count; i++){
+        addComponent(entityIDs[i], component);
+    }
 }
 
 template <typename T>
-void ComponentManager::addComponent(ID entityID, T component){
-    // this is where the pointer-magic happens
-    // get pointer for type, then send new component data
-    getComponentVector<T>()->addComponent(entityID, component);
+void TagVector<T>::addComponents(const ID* entityIDs, const T* values, size_t count){
+    for(size_t i = 0; i < count; i++){
+        addComponent(entityIDs[i], values[i]);
+    }
 }
 
 template <typename T>
-inline T& ComponentManager::getComponent(ID entityID) {
-    return getComponentVector<T>()->getComponent(entityID);
+set<ID>& TagVector<T>::getComponentEntities(){
+    // rebuild the set only when asked for and out of date
+    if(entitySetStale){
+        entitySet.clear();
+        forEach([&](ID entityID){ entitySet.emplace_hint(entitySet.end(), entityID); });
+        entitySetStale = false;
+    }
+    return entitySet;
 }
 
 template <typename T>
-set<ID>& ComponentManager::getComponentEntities(){
-    return getComponentVector<T>()->getComponentEntities();
+set<ID>& TagVector<T>::getNewComponentEntities(){
+    return newEntities;
 }
 
 template <typename T>
-set<ID>& ComponentManager::getNewComponentEntities(){
-    return getComponentVector<T>()->getNewComponentEntities();
+void TagVector<T>::groupEntities(){
+    // nothing to do, tags are grouped on add
 }
 
 template <typename T>
-void ComponentManager::groupEntities(){
-    return getComponentVector<T>()->groupEntities();
+void TagVector<T>::removeEntity(ID entityID){
+    if(!hasEntity(entityID)){
+        return;
+    }
+    bits[entityID / 64] &= ~(uint64_t(1) << (entityID % 64));
+    count--;
+    entitySetStale = true;
 }
 
-void ComponentManager::removeEntity(ID entityID){
-    for(const auto& [key, value] : componentVectors){
-        auto& component = value;
-        
-        component -> removeEntity(entityID);
+template <typename T>
+unique_ptr<IComponentPacket> TagVector<T>::extractEntity(ID entityID){
+    if(!hasEntity(entityID)){
+        return nullptr;
     }
+    removeEntity(entityID);
+    return std::make_unique<ComponentPacket<T>>(tag);
 }
 
-// ------- ECSManager ------- //
+template <typename T>
+T& TagVector<T>::getComponent(ID entityID){
+    if(!hasEntity(entityID)){
+        throw "error: entity does not have component";
+    }
+    return tag;
+}
 
-ECSManager::ECSManager(){
-    // add entity id for self
-    Entity& thisEntity = createEntity();
-    // set self id to entity id
-    managerID = thisEntity.getID();
+template <typename T>
+bool TagVector<T>::hasEntity(ID entityID){
+    size_t word = entityID / 64;
+    return word < bits.size() && (bits[word] >> (entityID % 64)) & 1;
 }
 
-template <typename T, typename... Args>
-Entity& ECSManager::createEntity(Args... args){
-    // check and see if T is derived from Entity
-    if(is_base_of<Entity,T>::value == 1){
-        // get unique ID
-        ID newID = generateEntityID();
-        // create entity with id and reference to manager
-        T entity(newID, this, args...);
+template <typename T>
+template <typename F>
+void TagVector<T>::forEach(F f){
+    for(size_t word = 0; word < bits.size(); word++){
+        // pop set bits lowest first
+        uint64_t remaining = bits[word];
+        while(remaining != 0){
+            f(static_cast<ID>(word * 64 + lowestBit(remaining)));
+            remaining &= remaining - 1;
+        }
+    }
+}
 
-        std::cout << " -------- creating entity at id: " << newID << std::endl;
+template <typename T>
+ComponentMemoryStats TagVector<T>::memoryStats(){
+    ComponentMemoryStats stats;
+    stats.name = typeName<T>();
+    stats.count = count;
+    stats.capacity = bits.capacity() * 64;
+    // no dense data at all, just the bitset (and the set if it was ever asked for)
+    stats.indexBytes = bits.capacity() * sizeof(uint64_t) + entitySet.size() * treeNodeBytes<ID>();
+    return stats;
+}
 
-        // add entity to vector
-        entities.insert({newID, entity});
-        // return reference to entity
-        return entities.at(newID);
+template <typename T>
+string TagVector<T>::checkInvariants(const std::function<bool(ID)>& isLive){
+    string name = typeName<T>();
+    size_t found = 0;
+    string problem;
+    forEach([&](ID entityID){
+        found++;
+        if(problem.empty() && !isLive(entityID)){
+            problem = name + ": entity " + std::to_string(entityID) + " was destroyed but is still tagged";
+        }
+    });
+    if(!problem.empty()){
+        return problem;
     }
+    if(found != count){
+        return name + ": " + std::to_string(found) + " tagged entities but count is " + std::to_string(count);
+    }
+    return "";
 }
 
-// constructor for entity, technically
-Entity& ECSManager::createEntity(){
-    // create generic entity
-    return createEntity<Entity>();
+template <typename T>
+PagedVector<T>::~PagedVector(){
+    for(const auto& [key, value] : indexes){
+        slot(value)->~T();
+    }
 }
 
-// destroys an entity
-void ECSManager::destroyEntity(ID entityID) {
-    // get entity from map
-    Entity& toDestroy = entities.at(entityID);
+template <typename T>
+unsigned PagedVector<T>::allocateSlot(ID entityID){
+    unsigned index;
+    // fill holes first so pages stay dense
+    if(!freeSlots.empty()){
+        index = freeSlots.back();
+        freeSlots.pop_back();
+    } else {
+        // new page when the last one is full
+        if(slotCount == pages.size() * ECPPS_PAGE_SIZE){
+            pages.emplace_back(std::make_unique<Page>());
+        }
+        index = slotCount++;
+    }
+    pages[index / ECPPS_PAGE_SIZE]->ids[index % ECPPS_PAGE_SIZE] = entityID;
+    return index;
+}
 
-    std::cout << " -------- deleting entity at id: " << entityID << std::endl;
+template <typename T>
+void PagedVector<T>::addComponent(ID entityID, T component){
+    // if entity already has this component, just overwrite it
+    auto existing = indexes.find(entityID);
+    if(existing != indexes.end()){
+        *slot(existing->second) = std::move(component);
+        return;
+    }
+    unsigned index = allocateSlot(entityID);
+    // construct in place, nothing else moves
+    new (slot(index)) T(std::move(component));
+    indexes.insert({entityID, index});
+    // add entity to init set
+    newEntities.emplace(entityID);
+    layoutVersion++;
+}
 
-    // remove entity from components
-    components.removeEntity(entityID);
-    // erase entity from id map
-    entities.erase(entityID);
-    // add entity id to reclaimable id list
-    reusableIDs.emplace_back(entityID);
+template <typename T>
+void PagedVector<T>::addComponents(const ID* entityIDs, size_t count, const T& component){
+    for(size_t i = 0; i < count; i++){
+        addComponent(entityIDs[i], component);
+    }
 }
 
-inline void ECSManager::setSpecialEntity(string entityName, Entity& entity){
-    // insert hehe (thought it was more complicated)
-    ID entityID = entity.getID();
+template <typename T>
+void PagedVector<T>::addComponents(const ID* entityIDs, const T* values, size_t count){
+    for(size_t i = 0; i < count; i++){
+        addComponent(entityIDs[i], values[i]);
+    }
+}
 
-    specialEntities.insert({entityName, entityID});
+template <typename T>
+set<ID>& PagedVector<T>::getComponentEntities(){
+    return entities;
+}
 
+template <typename T>
+set<ID>& PagedVector<T>::getNewComponentEntities(){
+    return newEntities;
 }
 
-inline ID& ECSManager::getSpecialEntity(string entityName){
-    // find value and return
-    // if in map
-    if(specialEntities.find(entityName) != specialEntities.end()){
-        // return entity
-        return specialEntities.at(entityName);
-        // else
-    } else {
-        throw "error: no special entity";
-    }
+template <typename T>
+void PagedVector<T>::groupEntities(){
+    // push init group into regular group
+    entities.insert(newEntities.begin(), newEntities.end());
+    // clear init group
+    newEntities.clear();
 }
 
 template <typename T>
-void ECSManager::addComponent(ID entityID, T component){ 
-    // check and see if object is derived from Component
-    if(is_base_of<Component,T>::value == 1){
-        // pass to component manager
-        components.addComponent<T>(entityID, component);
+void PagedVector<T>::removeEntity(ID entityID){
+    auto found = indexes.find(entityID);
+    if(found == indexes.end()){
+        return;
     }
+    unsigned index = found->second;
+    // destroy in place and leave a hole
+    slot(index)->~T();
+    pages[index / ECPPS_PAGE_SIZE]->ids[index % ECPPS_PAGE_SIZE] = nullEntity;
+    freeSlots.emplace_back(index);
+    indexes.erase(found);
+    entities.erase(entityID);
+    newEntities.erase(entityID);
+    layoutVersion++;
 }
 
 template <typename T>
-void ECSManager::addComponent(T component){ 
-    addComponent<T>(managerID, component);
+unique_ptr<IComponentPacket> PagedVector<T>::extractEntity(ID entityID){
+    auto found = indexes.find(entityID);
+    if(found == indexes.end()){
+        return nullptr;
+    }
+    // move component out before its slot is destroyed
+    unique_ptr<IComponentPacket> packet = std::make_unique<ComponentPacket<T>>(std::move(*slot(found->second)));
+    removeEntity(entityID);
+    return packet;
 }
 
 template <typename T>
-set<ID>& ECSManager::getComponentEntities(){
-    // check and see if object is derived from Component
-    if(is_base_of<Component,T>::value == 1){
-        // pass to component manager
-        return components.getComponentEntities<T>();
+T& PagedVector<T>::getComponent(ID entityID){
+    auto found = indexes.find(entityID);
+    if(found == indexes.end()){
+        throw "error: entity does not have component";
     }
+    return *slot(found->second);
 }
 
 template <typename T>
-set<ID>& ECSManager::getNewComponentEntities(){
-    return components.getNewComponentEntities<T>();
+bool PagedVector<T>::hasEntity(ID entityID){
+    return indexes.find(entityID) != indexes.end();
 }
 
 template <typename T>
-void ECSManager::groupEntities(){
-    return components.groupEntities<T>();
+template <typename F>
+void PagedVector<T>::forEachPage(F f){
+    for(size_t page = 0; page < pages.size(); page++){
+        // last page is only filled up to slotCount
+        size_t count = std::min<size_t>(ECPPS_PAGE_SIZE, slotCount - page * ECPPS_PAGE_SIZE);
+        f(Span<T>(pages[page]->slots(), count), Span<const ID>(pages[page]->ids, count));
+    }
 }
 
 template <typename T>
-inline T& ECSManager::getComponent(ID entityID) {
-    return components.getComponent<T>(entityID);
+template <typename F>
+void PagedVector<T>::forEach(F f){
+    forEachPage([&](Span<T> slots, Span<const ID> ids){
+        for(size_t i = 0; i < ids.size(); i++){
+            if(ids[i] != nullEntity){
+                f(ids[i], slots[i]);
+            }
+        }
+    });
 }
 
 template <typename T>
-inline T& ECSManager::getComponent() {
-    return getComponent<T>(managerID);
+ComponentMemoryStats PagedVector<T>::memoryStats(){
+    ComponentMemoryStats stats;
+    stats.name = typeName<T>();
+    stats.count = indexes.size();
+    stats.capacity = pages.size() * ECPPS_PAGE_SIZE;
+    stats.denseBytes = pages.size() * sizeof(Page);
+    // holes and the unused tail of the last page
+    stats.slackBytes = (stats.capacity - stats.count) * sizeof(T);
+    stats.indexBytes = indexes.size() * treeNodeBytes<std::pair<const ID, unsigned>>()
+        + (entities.size() + newEntities.size()) * treeNodeBytes<ID>()
+        + pages.capacity() * sizeof(unique_ptr<Page>)
+        + freeSlots.capacity() * sizeof(unsigned);
+    return stats;
 }
 
 template <typename T>
-void ECSManager::registerSystem(){
-    // check if system
-    if constexpr (is_base_of<System,T>::value == 1){
-        std::cout << typeid(T).name() << std::endl;
-        // create system
-        unique_ptr<T> system = std::make_unique<T>();
-        // next, add to vector
-        // check if render system
-        if constexpr (is_base_of<RenderSystem,T>::value == 1){
-            // if so, add to render systems
-            rsystems.emplace_back(std::move(system));
-            // init
-            rsystems.back()->init(this);
-        } else {
-            // otherwise, add to systems
-            systems.emplace_back(std::move(system));
-            // init
-            systems.back()->init(this);
+string PagedVector<T>::checkInvariants(const std::function<bool(ID)>& isLive){
+    string name = typeName<T>();
+    // every slot handed out is either in use or a hole
+    if(indexes.size() + freeSlots.size() != slotCount){
+        return name + ": " + std::to_string(indexes.size()) + " components and " + std::to_string(freeSlots.size()) + " holes for " + std::to_string(slotCount) + " slots";
+    }
+    for(const auto& [key, value] : indexes){
+        if(value >= slotCount){
+            return name + ": entity " + std::to_string(key) + " has slot " + std::to_string(value) + " past the end";
+        }
+        // slot owner agrees with the index (so no two entities share one)
+        if(pages[value / ECPPS_PAGE_SIZE]->ids[value % ECPPS_PAGE_SIZE] != key){
+            return name + ": slot " + std::to_string(value) + " belongs to entity " + std::to_string(key) + " but lists another owner";
+        }
+        // no component outlives its entity
+        if(!isLive(key)){
+            return name + ": entity " + std::to_string(key) + " was destroyed but still has a component";
+        }
+        // every indexed entity is in exactly one of the two sets
+        bool grouped = entities.count(key) != 0;
+        bool fresh = newEntities.count(key) != 0;
+        if(grouped == fresh){
+            return name + ": entity " + std::to_string(key) + (grouped ? " is in both entity sets" : " is in neither entity set");
+        }
+    }
+    for(unsigned index : freeSlots){
+        if(index >= slotCount || pages[index / ECPPS_PAGE_SIZE]->ids[index % ECPPS_PAGE_SIZE] != nullEntity){
+            return name + ": hole " + std::to_string(index) + " is still owned";
         }
     }
+    // and the sets hold nothing else
+    if(entities.size() + newEntities.size() != indexes.size()){
+        return name + ": entity sets hold entities without components";
+    }
+    return "";
 }
 
-ID ECSManager::generateEntityID(){
-    // prepare ID for return
-    ID toReturn;
-    // if available reusable ids
-    if(reusableIDs.size() != 0){
-        // pull the one from the end
-        toReturn = reusableIDs.back();
-        // remove the one from the end
-        reusableIDs.pop_back();
-    // if no reusable ids
-    } else {
-        // return current id pointer
-        toReturn = nextID;
-        // iterate id pointer
-        nextID++;
+template <typename T>
+string ComponentManager::mappedPath(){
+    // type name with anything awkward in a file name swapped out
+    string name = typeName<T>();
+    for(char& c : name){
+        if(!std::isalnum(static_cast<unsigned char>(c))){
+            c = '_';
+        }
+    }
+    // an explicit directory gets plain names so readers in other processes can find the columns
+    if(!mappedDirectory.empty()){
+        return mappedDirectory + "/" + name + ".column";
+    }
+    // the default directory is shared by every world, so the names carry this world's tag
+    if(mappedTag.empty()){
+        static std::atomic<uint64_t> serials{1};
+        mappedTag = std::to_string(serials.fetch_add(1, std::memory_order_relaxed));
+#ifdef ECPPS_MMAP
+        mappedTag = std::to_string(::getpid()) + "-" + mappedTag;
+#endif
     }
-    //return ID
-    return toReturn;
+    return "./" + name + "." + mappedTag + ".column";
 }
 
-void ECSManager::init(){
-    // update all systems
-    for(unique_ptr<System>& system : systems){
-        system->init(this);
+template <typename T>
+std::shared_ptr<ComponentStorage<T>> ComponentManager::getComponentVector(){
+    // first, get type_info to check
+    const char* typekey = typeid(T).name();
+
+    // check if map entry exists
+    if(componentVectors.find(typekey) == componentVectors.end()){
+        //if not, create one
+#ifdef ECPPS_MMAP
+        if constexpr (std::is_same<ComponentStorage<T>, MappedVector<T>>::value){
+            auto column = std::make_shared<MappedVector<T>>(mappedPath<T>());
+            // default columns are private to this world, only an explicit directory keeps its files
+            if(mappedDirectory.empty()){
+                column->removeFilesWhenClosed();
+            }
+            componentVectors.insert({typekey, column});
+        } else
+#endif
+        componentVectors.insert({typekey, std::make_shared<ComponentStorage<T>>()});
+        if constexpr (std::is_same<ComponentStorage<T>, BufferedVector<T>>::value){
+            bufferedVectors.emplace_back(componentVectors.at(typekey).get());
+        }
     }
-    // update all render systems
-    for(unique_ptr<RenderSystem>& rsystem : rsystems){
-        rsystem->init(this);
+
+    // return pointer for component vector
+    return std::static_pointer_cast<ComponentStorage<T>>(componentVectors.at(typekey));
+}
+
+template <typename T>
+void ComponentManager::addComponent(ID entityID, T component){
+    // this is where the pointer-magic happens
+    // get pointer for type, then send new component data
+    getComponentVector<T>()->addComponent(entityID, component);
+}
+
+template <typename T>
+void ComponentManager::addComponents(const vector<ID>& entityIDs, const T& component){
+    getComponentVector<T>()->addComponents(entityIDs.data(), entityIDs.size(), component);
+}
+
+template <typename T>
+void ComponentManager::addComponents(const vector<ID>& entityIDs, const vector<T>& values){
+    getComponentVector<T>()->addComponents(entityIDs.data(), values.data(), entityIDs.size());
+}
+
+template <typename T>
+inline T& ComponentManager::getComponent(ID entityID) {
+    return getComponentVector<T>()->getComponent(entityID);
+}
+
+template <typename T>
+inline bool ComponentManager::hasComponent(ID entityID) {
+    return getComponentVector<T>()->hasEntity(entityID);
+}
+
+template <typename T>
+void ComponentManager::removeComponent(ID entityID){
+    getComponentVector<T>()->removeEntity(entityID);
+}
+
+template <typename T>
+set<ID>& ComponentManager::getComponentEntities(){
+    return getComponentVector<T>()->getComponentEntities();
+}
+
+template <typename T>
+set<ID>& ComponentManager::getNewComponentEntities(){
+    return getComponentVector<T>()->getNewComponentEntities();
+}
+
+template <typename T>
+void ComponentManager::groupEntities(){
+    return getComponentVector<T>()->groupEntities();
+}
+
+void ComponentManager::swapBuffers(){
+    for(IComponentVector* buffered : bufferedVectors){
+        buffered->swapBuffers();
     }
 }
 
-void ECSManager::update(){
-    // update all systems
-    for(unique_ptr<System>& system : systems){
-        system->update(this);
+void ComponentManager::removeEntity(ID entityID){
+    for(const auto& [key, value] : componentVectors){
+        auto& component = value;
+        
+        component -> removeEntity(entityID);
     }
-    // update all render systems
-    for(unique_ptr<RenderSystem>& rsystem : rsystems){
-        rsystem->update(this);
+}
+
+void ComponentManager::removeEntities(const vector<ID>& entityIDs, const vector<Signature>& signatures){
+    for(const auto& [key, value] : componentVectors){
+        unsigned bit = value->signatureBit();
+        for(ID entityID : entityIDs){
+            if(signatures[entityID].test(bit)){
+                value->removeEntity(entityID);
+            }
+        }
     }
 }
 
-void ECSManager::render(){
-    // render all render systems
-    for(unique_ptr<RenderSystem>& rsystem : rsystems){
-        rsystem->render(this);
+void ComponentManager::extractEntity(ID entityID, EntityPacket& packet){
+    for(const auto& [key, value] : componentVectors){
+        unique_ptr<IComponentPacket> component = value->extractEntity(entityID);
+        if(component){
+            packet.components.emplace_back(std::move(component));
+        }
+    }
+}
+
+void ComponentManager::memoryStats(MemoryStats& stats){
+    for(const auto& [key, value] : componentVectors){
+        ComponentMemoryStats componentStats = value->memoryStats();
+        // count the storage object and its slot in the type map as index overhead
+        componentStats.indexBytes += treeNodeBytes<std::pair<const char* const, std::shared_ptr<IComponentVector>>>();
+        stats.componentBytes += componentStats.denseBytes + componentStats.indexBytes;
+        stats.components.emplace_back(componentStats);
+    }
+}
+
+string ComponentManager::checkInvariants(const map<ID, Entity>& liveEntities, const vector<Signature>& signatures){
+    // components may only belong to live entities
+    auto isLive = [&](ID entityID){ return liveEntities.find(entityID) != liveEntities.end(); };
+    for(const auto& [key, value] : componentVectors){
+        // check storage against itself
+        string problem = value->checkInvariants(isLive);
+        if(!problem.empty()){
+            return problem;
+        }
+        // signature bits agree with storage contents
+        unsigned bit = value->signatureBit();
+        for(const auto& [entityID, entity] : liveEntities){
+            bool marked = entityID < signatures.size() && signatures[entityID].test(bit);
+            if(marked != value->hasEntity(entityID)){
+                return string(key) + ": signature of entity " + std::to_string(entityID) + " disagrees with storage";
+            }
+        }
+    }
+    return "";
+}
+
+// ------- MappedVector ------- //
+
+#ifdef ECPPS_MMAP
+MappedFile::~MappedFile(){
+    unmap();
+    if(fd != -1){
+        // unlinked while still locked, so no other writer can pick it up in between
+        if(removeOnClose){
+            ::unlink(path.c_str());
+        }
+        ::close(fd);
+    }
+}
+
+void MappedFile::unmap(){
+    if(base != nullptr){
+        ::munmap(base, length);
+        base = nullptr;
+    }
+}
+
+void MappedFile::open(const string& path, bool readOnly){
+    this->readOnly = readOnly;
+    this->path = path;
+    fd = readOnly ? ::open(path.c_str(), O_RDONLY) : ::open(path.c_str(), O_RDWR | O_CREAT, 0644);
+    if(fd == -1){
+        throw "error: could not open mapped storage file";
+    }
+    if(readOnly){
+        refresh();
+        return;
+    }
+    // one writer per file (this world or any other), the lock goes away when fd is closed
+    // readers don't lock, they're allowed to watch a live column
+    if(::flock(fd, LOCK_EX | LOCK_NB) != 0){
+        ::close(fd);
+        fd = -1;
+        throw "error: mapped storage file is already open for writing";
+    }
+    // only empty it once it's ours
+    if(::ftruncate(fd, 0) != 0){
+        throw "error: could not empty mapped storage file";
+    }
+}
+
+void MappedFile::reserve(size_t bytes){
+    if(bytes <= length){
+        return;
+    }
+    if(readOnly){
+        throw "error: mapped storage is read only";
+    }
+    // at least double, rounded up to whole pages
+    size_t page = static_cast<size_t>(::sysconf(_SC_PAGESIZE));
+    size_t newLength = std::max(bytes, length * 2);
+    newLength = (newLength + page - 1) / page * page;
+    if(::ftruncate(fd, newLength) != 0){
+        throw "error: could not grow mapped storage file";
+    }
+    unmap();
+    base = ::mmap(nullptr, newLength, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if(base == MAP_FAILED){
+        base = nullptr;
+        throw "error: could not map storage file";
+    }
+    length = newLength;
+}
+
+void MappedFile::refresh(){
+    struct stat info;
+    if(::fstat(fd, &info) != 0){
+        throw "error: could not read mapped storage file";
+    }
+    size_t fileLength = static_cast<size_t>(info.st_size);
+    if(fileLength == length){
+        return;
+    }
+    unmap();
+    length = fileLength;
+    if(length != 0){
+        base = ::mmap(nullptr, length, PROT_READ, MAP_SHARED, fd, 0);
+        if(base == MAP_FAILED){
+            base = nullptr;
+            length = 0;
+            throw "error: could not map storage file";
+        }
+    }
+}
+
+template <typename T>
+MappedVector<T>::MappedVector(const string& path, bool readOnly) : readOnly(readOnly) {
+    dataFile.open(path, readOnly);
+    idFile.open(path + ".ids", readOnly);
+    if(readOnly){
+        // written by someone else, check it holds this type
+        if(idFile.size() < sizeof(MappedHeader) || header()->magic != hashName("ecpps column") || header()->elementSize != sizeof(T)){
+            throw "error: mapped storage file does not hold this component type";
+        }
+        refresh();
+        return;
+    }
+    idFile.reserve(sizeof(MappedHeader));
+    *header() = MappedHeader{hashName("ecpps column"), sizeof(T), 0};
+}
+
+template <typename T>
+void MappedVector<T>::removeFilesWhenClosed(){
+    checkWritable();
+    dataFile.removeWhenClosed();
+    idFile.removeWhenClosed();
+}
+
+template <typename T>
+void MappedVector<T>::checkWritable(){
+    if(readOnly){
+        throw "error: mapped storage is read only";
+    }
+}
+
+template <typename T>
+void MappedVector<T>::grow(size_t count){
+    dataFile.reserve(count * sizeof(T));
+    idFile.reserve(sizeof(MappedHeader) + count * sizeof(ID));
+}
+
+template <typename T>
+void MappedVector<T>::rebuildPositions(){
+    positions.assign(positions.size(), nullEntity);
+    Span<const ID> owners = ids();
+    for(size_t index = 0; index < owners.size(); index++){
+        if(owners[index] >= positions.size()){
+            positions.resize(owners[index] + 1, nullEntity);
+        }
+        positions[owners[index]] = index;
+    }
+    layoutVersion++;
+}
+
+template <typename T>
+void MappedVector<T>::refresh(){
+    if(!readOnly){
+        return;
+    }
+    idFile.refresh();
+    dataFile.refresh();
+    // the header may already count components whose pages aren't mapped here yet
+    size_t mappedIDs = idFile.size() < sizeof(MappedHeader) ? 0 : (idFile.size() - sizeof(MappedHeader)) / sizeof(ID);
+    size_t mappedComponents = dataFile.size() / sizeof(T);
+    readableCount = mappedIDs == 0 ? 0 : std::min<size_t>(header()->count, std::min(mappedIDs, mappedComponents));
+    rebuildPositions();
+    entitySetStale = true;
+}
+
+template <typename T>
+void MappedVector<T>::addComponent(ID entityID, T component){
+    checkWritable();
+    // if entity already has this component, just overwrite it
+    if(hasEntity(entityID)){
+        components()[positions[entityID]] = component;
+        return;
+    }
+    size_t index = header()->count;
+    grow(index + 1);
+    components()[index] = component;
+    componentIDs()[index] = entityID;
+    header()->count = index + 1;
+    if(entityID >= positions.size()){
+        positions.resize(entityID + 1, nullEntity);
+    }
+    positions[entityID] = index;
+    entitySetStale = true;
+    layoutVersion++;
+}
+
+template <typename T>
+void MappedVector<T>::addComponents(const ID* entityIDs, size_t count, const T& component){
+    checkWritable();
+    // one remap for the whole block
+    grow(header()->count + count);
+    for(size_t i = 0; i < count; i++){
+        addComponent(entityIDs[i], component);
+    }
+}
+
+template <typename T>
+void MappedVector<T>::addComponents(const ID* entityIDs, const T* values, size_t count){
+    checkWritable();
+    // one remap for the whole block
+    grow(header()->count + count);
+    for(size_t i = 0; i < count; i++){
+        addComponent(entityIDs[i], values[i]);
+    }
+}
+
+template <typename T>
+set<ID>& MappedVector<T>::getComponentEntities(){
+    // rebuild the set only when asked for and out of date
+    if(entitySetStale){
+        Span<const ID> owners = ids();
+        entitySet = set<ID>(owners.begin(), owners.end());
+        entitySetStale = false;
+    }
+    return entitySet;
+}
+
+template <typename T>
+set<ID>& MappedVector<T>::getNewComponentEntities(){
+    return newEntities;
+}
+
+template <typename T>
+void MappedVector<T>::groupEntities(){
+    // nothing to do, components are grouped on add
+}
+
+template <typename T>
+void MappedVector<T>::removeEntity(ID entityID){
+    if(!hasEntity(entityID)){
+        return;
+    }
+    checkWritable();
+    // swap and pop, only the last component moves
+    unsigned index = positions[entityID];
+    unsigned last = header()->count - 1;
+    if(index != last){
+        components()[index] = components()[last];
+        componentIDs()[index] = componentIDs()[last];
+        positions[componentIDs()[index]] = index;
+    }
+    header()->count = last;
+    positions[entityID] = nullEntity;
+    entitySetStale = true;
+    layoutVersion++;
+}
+
+template <typename T>
+unique_ptr<IComponentPacket> MappedVector<T>::extractEntity(ID entityID){
+    if(!hasEntity(entityID)){
+        return nullptr;
+    }
+    unique_ptr<IComponentPacket> packet = std::make_unique<ComponentPacket<T>>(components()[positions[entityID]]);
+    removeEntity(entityID);
+    return packet;
+}
+
+template <typename T>
+T& MappedVector<T>::getComponent(ID entityID){
+    if(!hasEntity(entityID)){
+        throw "error: entity does not have component";
+    }
+    // (read only columns are mapped read only, writing through this faults)
+    return components()[positions[entityID]];
+}
+
+template <typename T>
+bool MappedVector<T>::hasEntity(ID entityID){
+    return entityID < positions.size() && positions[entityID] != nullEntity;
+}
+
+template <typename T>
+ComponentMemoryStats MappedVector<T>::memoryStats(){
+    ComponentMemoryStats stats;
+    stats.name = typeName<T>();
+    stats.count = count();
+    stats.capacity = dataFile.size() / sizeof(T);
+    // mapped bytes, only the pages in use are actually resident
+    stats.denseBytes = dataFile.size() + idFile.size();
+    stats.slackBytes = (stats.capacity - stats.count) * sizeof(T);
+    stats.indexBytes = positions.capacity() * sizeof(unsigned) + entitySet.size() * treeNodeBytes<ID>();
+    return stats;
+}
+
+template <typename T>
+string MappedVector<T>::checkInvariants(const std::function<bool(ID)>& isLive){
+    string name = typeName<T>();
+    Span<const ID> owners = ids();
+    size_t indexed = 0;
+    for(size_t index = 0; index < owners.size(); index++){
+        ID entityID = owners[index];
+        // position table agrees with the id column
+        if(!hasEntity(entityID) || positions[entityID] != index){
+            return name + ": slot " + std::to_string(index) + " lists entity " + std::to_string(entityID) + " but its position disagrees";
+        }
+        if(!isLive(entityID)){
+            return name + ": entity " + std::to_string(entityID) + " was destroyed but still has a component";
+        }
+    }
+    for(unsigned position : positions){
+        indexed += position != nullEntity;
+    }
+    if(indexed != owners.size()){
+        return name + ": " + std::to_string(indexed) + " positions for " + std::to_string(owners.size()) + " components";
+    }
+    return "";
+}
+#endif
+
+// ------- BufferedVector ------- //
+
+template <typename T>
+void BufferedVector<T>::addComponent(ID entityID, T component){
+    Buffer& buffer = backBuffer();
+    // if entity already has this component, just overwrite it
+    if(hasEntity(entityID)){
+        buffer.components[buffer.positions[entityID]] = component;
+        markDirty(entityID);
+        return;
+    }
+    if(entityID >= buffer.positions.size()){
+        buffer.positions.resize(entityID + 1, nullEntity);
+    }
+    buffer.positions[entityID] = buffer.components.size();
+    touchedSlots.emplace_back(buffer.components.size());
+    buffer.components.emplace_back(component);
+    buffer.componentIDs.emplace_back(entityID);
+    // add entity to init set
+    newEntities.emplace(entityID);
+    structureChanged = true;
+    layoutVersion++;
+}
+
+template <typename T>
+void BufferedVector<T>::addComponents(const ID* entityIDs, size_t count, const T& component){
+    backBuffer().components.reserve(backBuffer().components.size() + count);
+    backBuffer().componentIDs.reserve(backBuffer().componentIDs.size() + count);
+    for(size_t i = 0; i < count; i++){
+        addComponent(entityIDs[i], component);
+    }
+}
+
+template <typename T>
+void BufferedVector<T>::addComponents(const ID* entityIDs, const T* values, size_t count){
+    backBuffer().components.reserve(backBuffer().components.size() + count);
+    backBuffer().componentIDs.reserve(backBuffer().componentIDs.size() + count);
+    for(size_t i = 0; i < count; i++){
+        addComponent(entityIDs[i], values[i]);
+    }
+}
+
+template <typename T>
+set<ID>& BufferedVector<T>::getComponentEntities(){
+    return entities;
+}
+
+template <typename T>
+set<ID>& BufferedVector<T>::getNewComponentEntities(){
+    return newEntities;
+}
+
+template <typename T>
+void BufferedVector<T>::groupEntities(){
+    // push init group into regular group
+    entities.insert(newEntities.begin(), newEntities.end());
+    // clear init group
+    newEntities.clear();
+}
+
+template <typename T>
+void BufferedVector<T>::removeEntity(ID entityID){
+    if(!hasEntity(entityID)){
+        return;
+    }
+    Buffer& buffer = backBuffer();
+    // swap and pop in the back copy only, readers keep seeing it until the swap
+    unsigned index = buffer.positions[entityID];
+    unsigned last = buffer.components.size() - 1;
+    if(index != last){
+        buffer.components[index] = std::move(buffer.components[last]);
+        buffer.componentIDs[index] = buffer.componentIDs[last];
+        buffer.positions[buffer.componentIDs[index]] = index;
+        touchedSlots.emplace_back(index);
+    }
+    buffer.components.pop_back();
+    buffer.componentIDs.pop_back();
+    buffer.positions[entityID] = nullEntity;
+    removedIDs.emplace_back(entityID);
+    entities.erase(entityID);
+    newEntities.erase(entityID);
+    structureChanged = true;
+    layoutVersion++;
+}
+
+template <typename T>
+unique_ptr<IComponentPacket> BufferedVector<T>::extractEntity(ID entityID){
+    if(!hasEntity(entityID)){
+        return nullptr;
+    }
+    // move component out before removing its slot
+    unique_ptr<IComponentPacket> packet = std::make_unique<ComponentPacket<T>>(std::move(*peek(entityID)));
+    removeEntity(entityID);
+    return packet;
+}
+
+template <typename T>
+T& BufferedVector<T>::getComponent(ID entityID){
+    T* component = peek(entityID);
+    // callers can write through the reference, so assume they do
+    markDirty(entityID);
+    return *component;
+}
+
+template <typename T>
+T* BufferedVector<T>::peek(ID entityID){
+    if(!hasEntity(entityID)){
+        throw "error: entity does not have component";
+    }
+    return &backBuffer().components[backBuffer().positions[entityID]];
+}
+
+template <typename T>
+Span<T> BufferedVector<T>::data(){
+    allDirty = true;
+    return Span<T>(backBuffer().components.data(), backBuffer().components.size());
+}
+
+template <typename T>
+bool BufferedVector<T>::hasEntity(ID entityID){
+    const vector<unsigned>& positions = backBuffer().positions;
+    return entityID < positions.size() && positions[entityID] != nullEntity;
+}
+
+template <typename T>
+void BufferedVector<T>::markDirty(ID entityID){
+    if(entityID >= dirtyFlags.size()){
+        dirtyFlags.resize(entityID + 1, false);
+    }
+    if(!dirtyFlags[entityID]){
+        dirtyFlags[entityID] = true;
+        dirty.emplace_back(entityID);
+    }
+}
+
+template <typename T>
+const T& BufferedVector<T>::read(ID entityID){
+    if(!frontHas(entityID)){
+        throw "error: entity does not have component";
+    }
+    return frontBuffer().components[frontBuffer().positions[entityID]];
+}
+
+template <typename T>
+bool BufferedVector<T>::frontHas(ID entityID){
+    const vector<unsigned>& positions = frontBuffer().positions;
+    return entityID < positions.size() && positions[entityID] != nullEntity;
+}
+
+template <typename T>
+void BufferedVector<T>::swapBuffers(){
+    // this frame's writes become what readers see
+    back ^= 1;
+    Buffer& front = frontBuffer();
+    Buffer& buffer = backBuffer();
+    if(structureChanged){
+        // both copies had the same layout at the last swap, so only the slots this frame's
+        // adds and removes wrote (and the end, which grew or shrank) differ
+        size_t oldSize = buffer.components.size();
+        size_t newSize = front.components.size();
+        if(newSize < oldSize){
+            buffer.components.erase(buffer.components.begin() + newSize, buffer.components.end());
+            buffer.componentIDs.resize(newSize);
+        } else {
+            buffer.components.insert(buffer.components.end(), front.components.begin() + oldSize, front.components.end());
+            buffer.componentIDs.insert(buffer.componentIDs.end(), front.componentIDs.begin() + oldSize, front.componentIDs.end());
+        }
+        buffer.positions.resize(front.positions.size(), nullEntity);
+        for(ID entityID : removedIDs){
+            buffer.positions[entityID] = nullEntity;
+        }
+        for(unsigned slot : touchedSlots){
+            if(slot < std::min(oldSize, newSize)){
+                buffer.components[slot] = front.components[slot];
+                buffer.componentIDs[slot] = front.componentIDs[slot];
+            }
+        }
+        // entities that moved or arrived point at their new slots
+        for(unsigned slot : touchedSlots){
+            if(slot < newSize){
+                buffer.positions[buffer.componentIDs[slot]] = slot;
+            }
+        }
+        for(size_t slot = oldSize; slot < newSize; slot++){
+            buffer.positions[buffer.componentIDs[slot]] = slot;
+        }
+    }
+    if(allDirty){
+        // every slot may have been written through data()
+        std::copy(front.components.begin(), front.components.end(), buffer.components.begin());
+    } else {
+        // same layout now, only written components are out of date
+        for(ID entityID : dirty){
+            if(entityID < front.positions.size() && front.positions[entityID] != nullEntity){
+                unsigned index = front.positions[entityID];
+                buffer.components[index] = front.components[index];
+            }
+        }
+    }
+    for(ID entityID : dirty){
+        dirtyFlags[entityID] = false;
+    }
+    dirty.clear();
+    touchedSlots.clear();
+    removedIDs.clear();
+    structureChanged = false;
+    allDirty = false;
+    // writers now hold the other copy
+    layoutVersion++;
+}
+
+template <typename T>
+ComponentMemoryStats BufferedVector<T>::memoryStats(){
+    ComponentMemoryStats stats;
+    stats.name = typeName<T>();
+    stats.count = backBuffer().components.size();
+    stats.capacity = backBuffer().components.capacity();
+    for(const Buffer& buffer : buffers){
+        stats.denseBytes += buffer.components.capacity() * sizeof(T);
+        stats.slackBytes += (buffer.components.capacity() - buffer.components.size()) * sizeof(T);
+        stats.indexBytes += buffer.componentIDs.capacity() * sizeof(ID) + buffer.positions.capacity() * sizeof(unsigned);
+    }
+    stats.indexBytes += (entities.size() + newEntities.size()) * treeNodeBytes<ID>()
+        + dirty.capacity() * sizeof(ID) + dirtyFlags.capacity() / 8
+        + touchedSlots.capacity() * sizeof(unsigned) + removedIDs.capacity() * sizeof(ID);
+    return stats;
+}
+
+template <typename T>
+string BufferedVector<T>::checkInvariants(const std::function<bool(ID)>& isLive){
+    string name = typeName<T>();
+    Buffer& buffer = backBuffer();
+    if(buffer.componentIDs.size() != buffer.components.size()){
+        return name + ": " + std::to_string(buffer.componentIDs.size()) + " ids for " + std::to_string(buffer.components.size()) + " components";
+    }
+    size_t indexed = 0;
+    for(unsigned position : buffer.positions){
+        indexed += position != nullEntity;
+    }
+    if(indexed != buffer.components.size()){
+        return name + ": " + std::to_string(indexed) + " positions for " + std::to_string(buffer.components.size()) + " components";
+    }
+    for(size_t index = 0; index < buffer.componentIDs.size(); index++){
+        ID entityID = buffer.componentIDs[index];
+        // position table agrees with the id list
+        if(!hasEntity(entityID) || buffer.positions[entityID] != index){
+            return name + ": slot " + std::to_string(index) + " lists entity " + std::to_string(entityID) + " but its position disagrees";
+        }
+        // no component outlives its entity
+        if(!isLive(entityID)){
+            return name + ": entity " + std::to_string(entityID) + " was destroyed but still has a component";
+        }
+        // every entity is in exactly one of the two sets
+        bool grouped = entities.count(entityID) != 0;
+        bool fresh = newEntities.count(entityID) != 0;
+        if(grouped == fresh){
+            return name + ": entity " + std::to_string(entityID) + (grouped ? " is in both entity sets" : " is in neither entity set");
+        }
+    }
+    // and the sets hold nothing else
+    if(entities.size() + newEntities.size() != buffer.components.size()){
+        return name + ": entity sets hold entities without components";
+    }
+    return "";
+}
+
+// ------- SpatialIndex ------- //
+
+template <typename T>
+SpatialIndex<T>::SpatialIndex(std::shared_ptr<ComponentStorage<T>> storage, const vector<Signature>& signatures, float cellSize)
+    : storage(storage), signatures(signatures), cellSize(cellSize), inverseCellSize(1.0f / cellSize) {
+    // queue everything that already has the component
+    for(ID entityID : storage->getNewComponentEntities()){
+        entityChanged(entityID);
+    }
+    for(ID entityID : storage->getComponentEntities()){
+        entityChanged(entityID);
+    }
+    flush();
+}
+
+template <typename T>
+int32_t SpatialIndex<T>::cellCoord(float value) const {
+    return static_cast<int32_t>(std::floor(value * inverseCellSize));
+}
+
+template <typename T>
+uint64_t SpatialIndex<T>::cellKey(int32_t cellX, int32_t cellY){
+    return (static_cast<uint64_t>(static_cast<uint32_t>(cellX)) << 32) | static_cast<uint32_t>(cellY);
+}
+
+template <typename T>
+typename SpatialIndex<T>::Entry& SpatialIndex<T>::getEntry(ID entityID){
+    if(entityID >= entries.size()){
+        entries.resize(entityID + 1);
+    }
+    return entries[entityID];
+}
+
+template <typename T>
+void SpatialIndex<T>::removeFromCell(ID entityID, Entry& entry){
+    // swap and pop out of the cell list
+    vector<ID>& cell = cells[entry.cell];
+    ID moved = cell.back();
+    cell[entry.slot] = moved;
+    entries[moved].slot = entry.slot;
+    cell.pop_back();
+    // drop empty cells so queries don't walk them
+    if(cell.empty()){
+        cells.erase(entry.cell);
+    }
+    entry.present = false;
+    count--;
+}
+
+template <typename T>
+void SpatialIndex<T>::entityChanged(ID entityID){
+    Entry& entry = getEntry(entityID);
+    // only queue once per flush
+    if(!entry.queued){
+        entry.queued = true;
+        pending.emplace_back(entityID);
+    }
+}
+
+template <typename T>
+void SpatialIndex<T>::entityRemoved(ID entityID){
+    if(entityID >= entries.size()){
+        return;
+    }
+    Entry& entry = entries[entityID];
+    if(entry.present){
+        removeFromCell(entityID, entry);
+    }
+    // any queued update is stale now, flush will skip it
+    entry.queued = false;
+}
+
+template <typename T>
+void SpatialIndex<T>::flush(){
+    for(ID entityID : pending){
+        Entry& entry = entries[entityID];
+        // skip entities removed after being queued
+        if(!entry.queued){
+            continue;
+        }
+        entry.queued = false;
+        if(!storage->hasEntity(entityID)){
+            continue;
+        }
+        // read new position
+        const T& component = storage->getComponent(entityID);
+        entry.x = SpatialTraits<T>::x(component);
+        entry.y = SpatialTraits<T>::y(component);
+        uint64_t key = cellKey(cellCoord(entry.x), cellCoord(entry.y));
+        // still in the same cell, nothing else to do
+        if(entry.present && entry.cell == key){
+            continue;
+        }
+        if(entry.present){
+            removeFromCell(entityID, entry);
+        }
+        // add to new cell
+        vector<ID>& cell = cells[key];
+        entry.cell = key;
+        entry.slot = cell.size();
+        entry.present = true;
+        cell.emplace_back(entityID);
+        count++;
+    }
+    pending.clear();
+}
+
+template <typename T>
+size_t SpatialIndex<T>::queryAABB(float minX, float minY, float maxX, float maxY, vector<ID>& out, bool includeDisabled){
+    out.clear();
+    int32_t firstX = cellCoord(minX), lastX = cellCoord(maxX);
+    int32_t firstY = cellCoord(minY), lastY = cellCoord(maxY);
+    if(lastX < firstX || lastY < firstY){
+        return 0;
+    }
+    // a box covering more cells than are occupied is cheaper to answer from the occupied cells
+    uint64_t boxCells = static_cast<uint64_t>(int64_t(lastX) - firstX + 1) * static_cast<uint64_t>(int64_t(lastY) - firstY + 1);
+    if(boxCells > cells.size()){
+        for(const auto& [key, cell] : cells){
+            int32_t cellX = static_cast<int32_t>(static_cast<uint32_t>(key >> 32));
+            int32_t cellY = static_cast<int32_t>(static_cast<uint32_t>(key));
+            if(cellX < firstX || cellX > lastX || cellY < firstY || cellY > lastY){
+                continue;
+            }
+            for(ID entityID : cell){
+                const Entry& entry = entries[entityID];
+                if(entry.x >= minX && entry.x <= maxX && entry.y >= minY && entry.y <= maxY && visible(entityID, includeDisabled)){
+                    out.emplace_back(entityID);
+                }
+            }
+        }
+        return out.size();
+    }
+    // walk overlapped cells, testing exact positions
+    for(int32_t cellX = firstX; cellX <= lastX; cellX++){
+        for(int32_t cellY = firstY; cellY <= lastY; cellY++){
+            auto found = cells.find(cellKey(cellX, cellY));
+            if(found == cells.end()){
+                continue;
+            }
+            for(ID entityID : found->second){
+                const Entry& entry = entries[entityID];
+                if(entry.x >= minX && entry.x <= maxX && entry.y >= minY && entry.y <= maxY && visible(entityID, includeDisabled)){
+                    out.emplace_back(entityID);
+                }
+            }
+        }
+    }
+    return out.size();
+}
+
+template <typename T>
+size_t SpatialIndex<T>::queryRadius(float x, float y, float radius, vector<ID>& out, bool includeDisabled){
+    // box query then trim the corners
+    queryAABB(x - radius, y - radius, x + radius, y + radius, out, includeDisabled);
+    float radiusSquared = radius * radius;
+    out.erase(std::remove_if(out.begin(), out.end(), [&](ID entityID){
+        float dx = entries[entityID].x - x, dy = entries[entityID].y - y;
+        return dx * dx + dy * dy > radiusSquared;
+    }), out.end());
+    return out.size();
+}
+
+template <typename T>
+size_t SpatialIndex<T>::nearestK(float x, float y, size_t k, vector<ID>& out, bool includeDisabled){
+    out.clear();
+    candidates.clear();
+    k = std::min(k, count);
+    if(k == 0){
+        return 0;
+    }
+    int32_t centerX = cellCoord(x), centerY = cellCoord(y);
+    // gathers every entity in one cell as a candidate
+    auto gather = [&](int32_t cellX, int32_t cellY){
+        auto found = cells.find(cellKey(cellX, cellY));
+        if(found == cells.end()){
+            return;
+        }
+        for(ID entityID : found->second){
+            if(!visible(entityID, includeDisabled)){
+                continue;
+            }
+            float dx = entries[entityID].x - x, dy = entries[entityID].y - y;
+            candidates.emplace_back(dx * dx + dy * dy, entityID);
+        }
+    };
+    // search square rings of cells outwards from the point
+    for(int32_t ring = 0; ; ring++){
+        // once the square covers more cells than are occupied, walking empty ones costs more
+        // than scanning every occupied cell (points far outside the populated area hit this)
+        uint64_t side = 2 * static_cast<uint64_t>(ring) + 1;
+        if(ring > 0 && side * side > cells.size()){
+            candidates.clear();
+            for(const auto& [key, cell] : cells){
+                for(ID entityID : cell){
+                    if(!visible(entityID, includeDisabled)){
+                        continue;
+                    }
+                    float dx = entries[entityID].x - x, dy = entries[entityID].y - y;
+                    candidates.emplace_back(dx * dx + dy * dy, entityID);
+                }
+            }
+            break;
+        }
+        if(ring == 0){
+            gather(centerX, centerY);
+        } else {
+            for(int32_t offset = -ring; offset <= ring; offset++){
+                gather(centerX + offset, centerY - ring);
+                gather(centerX + offset, centerY + ring);
+            }
+            for(int32_t offset = -ring + 1; offset <= ring - 1; offset++){
+                gather(centerX - ring, centerY + offset);
+                gather(centerX + ring, centerY + offset);
+            }
+        }
+        if(candidates.size() < k){
+            continue;
+        }
+        // anything in a further ring is at least ring * cellSize away
+        std::nth_element(candidates.begin(), candidates.begin() + (k - 1), candidates.end());
+        float reach = ring * cellSize;
+        if(candidates[k - 1].first <= reach * reach || candidates.size() == count){
+            break;
+        }
+    }
+    // fewer than k may be left once disabled entities are skipped
+    k = std::min(k, candidates.size());
+    // sort the winners nearest first
+    std::partial_sort(candidates.begin(), candidates.begin() + k, candidates.end());
+    for(size_t i = 0; i < k; i++){
+        out.emplace_back(candidates[i].second);
+    }
+    return out.size();
+}
+
+// ------- ECSManager ------- //
+
+ECSManager::ECSManager(){
+    // add entity id for self
+    Entity& thisEntity = createEntity();
+    // set self id to entity id
+    managerID = thisEntity.getID();
+}
+
+ECSManager::~ECSManager(){
+#ifdef ECPPS_COROUTINES
+    // wait for running background jobs before anything they might touch goes away
+    jobPool.reset();
+#endif
+    // drop anything still waiting in the transfer queue
+    TransferNode* node = inbox.exchange(nullptr);
+    while(node != nullptr){
+        TransferNode* next = node->next;
+        delete node;
+        node = next;
+    }
+    // and in the cross thread command queue
+    CommandNode* command = concurrentCommands.exchange(nullptr);
+    while(command != nullptr){
+        CommandNode* next = command->next;
+        delete command;
+        command = next;
+    }
+}
+
+template <typename T, typename... Args>
+Entity& ECSManager::createEntity(Args... args){
+    return createEntityWithID<T>(generateEntityID(), args...);
+}
+
+template <typename T, typename... Args>
+Entity& ECSManager::createEntityWithID(ID newID, Args... args){
+    // check and see if T is derived from Entity
+    if(is_base_of<Entity,T>::value == 1){
+        // ready the signature first, the entity's init may add components
+        createSignature(newID);
+        // create entity with id and reference to manager
+        T entity(newID, this, args...);
+
+#ifdef ECPPS_DEBUG
+        std::cout << " -------- creating entity at id: " << newID << std::endl;
+#endif
+
+        // add entity to vector
+        entities.insert({newID, entity});
+        // return reference to entity
+        return entities.at(newID);
+    }
+}
+
+// constructor for entity, technically
+Entity& ECSManager::createEntity(){
+    // create generic entity
+    return createEntity<Entity>();
+}
+
+// destroys an entity
+void ECSManager::destroyEntity(ID entityID) {
+    // make sure entity exists
+    if(entities.find(entityID) == entities.end()){
+        throw "error: no entity with id";
+    }
+
+#ifdef ECPPS_DEBUG
+    std::cout << " -------- deleting entity at id: " << entityID << std::endl;
+#endif
+
+    // anything attached to this entity goes with it
+    if(hasComponent<Hierarchy>(entityID)){
+        for(ID child : getChildren(entityID)){
+            destroyEntity(child);
+        }
+        detachFromParent(getComponent<Hierarchy>(entityID));
+        hierarchyChanged = true;
+    }
+    unlinkEntity(entityID);
+    // remove entity from components
+    components.removeEntity(entityID);
+    if(!isEnabled(entityID)){
+        disabledCount--;
+    }
+    // no components, not alive
+    signatures[entityID] = Signature();
+    // erase entity from id map
+    entities.erase(entityID);
+    // add entity id to reclaimable id list
+    idAllocator.release(entityID);
+}
+
+void ECSManager::destroyEntities(const vector<ID>& entityIDs){
+    // make sure every entity exists before touching any of them
+    for(ID entityID : entityIDs){
+        if(entities.find(entityID) == entities.end()){
+            throw "error: no entity with id";
+        }
+    }
+    // children go with their parents, so the batch grows to whole subtrees (each entity once)
+    vector<char> doomed(idAllocator.issued(), 0);
+    vector<ID> batch;
+    batch.reserve(entityIDs.size());
+    for(ID entityID : entityIDs){
+        if(!doomed[entityID]){
+            doomed[entityID] = 1;
+            batch.emplace_back(entityID);
+        }
+    }
+    for(size_t i = 0; i < batch.size(); i++){
+        if(!hasComponent<Hierarchy>(batch[i])){
+            continue;
+        }
+        for(ID child = getComponent<Hierarchy>(batch[i]).firstChild; child != nullEntity; child = getComponent<Hierarchy>(child).nextSibling){
+            if(!doomed[child]){
+                doomed[child] = 1;
+                batch.emplace_back(child);
+            }
+        }
+    }
+    // only links into surviving parents need patching
+    for(ID entityID : batch){
+        if(hasComponent<Hierarchy>(entityID)){
+            Hierarchy& node = getComponent<Hierarchy>(entityID);
+            if(node.parent != nullEntity && !doomed[node.parent]){
+                detachFromParent(node);
+            }
+            hierarchyChanged = true;
+        }
+    }
+    for(ID entityID : batch){
+        unlinkEntity(entityID);
+    }
+    // one pass per storage, only over the entities that have that component
+    components.removeEntities(batch, signatures);
+    for(ID entityID : batch){
+        if(!isEnabled(entityID)){
+            disabledCount--;
+        }
+        signatures[entityID] = Signature();
+        entities.erase(entityID);
+        idAllocator.release(entityID);
+    }
+}
+
+void ECSManager::unlinkEntity(ID entityID){
+    // forget any names pointing at this entity
+    if(specialEntityCount != 0){
+        for(SpecialEntitySlot& slot : specialEntities){
+            if(slot.entity == entityID){
+                slot.entity = nullEntity;
+                specialEntityCount--;
+            }
+        }
+    }
+    // a destroyed pooled entity can't be handed out again
+    bool wasParked = entityID < parked.size() && parked[entityID];
+    if(wasParked){
+        parked[entityID] = false;
+    }
+    if(entityID < poolOwners.size() && poolOwners[entityID] != nullptr){
+        if(wasParked){
+            vector<ID>& pool = poolOwners[entityID]->pool;
+            pool.erase(std::remove(pool.begin(), pool.end(), entityID), pool.end());
+        }
+        poolOwners[entityID] = nullptr;
+    }
+    // forget which partition it came with, so unloading can't hit a reused id
+    if(entityID < partitionOwners.size()){
+        partitionOwners[entityID] = nullptr;
+    }
+    // pull out of spatial indexes right away so queries never return dead ids
+    for(const auto& [key, value] : spatialIndexes){
+        value->entityRemoved(entityID);
+    }
+    // same for cached queries
+    for(IQuery* cached : allQueries){
+        cached->entityRemoved(entityID);
+    }
+}
+
+SpecialEntitySlot& ECSManager::findSpecialSlot(uint64_t hash){
+    // table always has at least one empty slot, so probing stops
+    size_t mask = specialEntities.size() - 1;
+    size_t slot = hash & mask;
+    while(specialEntities[slot].hash != hash && specialEntities[slot].hash != 0){
+        slot = (slot + 1) & mask;
+    }
+    return specialEntities[slot];
+}
+
+inline void ECSManager::setSpecialEntity(EntityName entityName, Entity& entity){
+    setSpecialEntity(entityName, entity.getID());
+}
+
+inline void ECSManager::setSpecialEntity(EntityName entityName, ID entityID){
+    // keep table at most half full, dropping removed names when it grows
+    if(specialEntities.empty() || (usedSpecialSlots + 1) * 2 > specialEntities.size()){
+        vector<SpecialEntitySlot> old = std::move(specialEntities);
+        specialEntities.assign(std::max<size_t>(16, old.size() * 2), SpecialEntitySlot());
+        usedSpecialSlots = 0;
+        for(const SpecialEntitySlot& slot : old){
+            if(slot.entity != nullEntity){
+                findSpecialSlot(slot.hash) = slot;
+                usedSpecialSlots++;
+            }
+        }
+    }
+    SpecialEntitySlot& slot = findSpecialSlot(entityName.hash);
+    // claim a fresh slot
+    if(slot.hash == 0){
+        slot.hash = entityName.hash;
+        usedSpecialSlots++;
+    }
+    if(slot.entity == nullEntity){
+        specialEntityCount++;
+    }
+    slot.entity = entityID;
+}
+
+inline ID ECSManager::getSpecialEntity(EntityName entityName){
+    // find value and return
+    if(!specialEntities.empty()){
+        ID entityID = findSpecialSlot(entityName.hash).entity;
+        if(entityID != nullEntity){
+            return entityID;
+        }
+    }
+    throw "error: no special entity";
+}
+
+inline bool ECSManager::hasSpecialEntity(EntityName entityName){
+    return !specialEntities.empty() && findSpecialSlot(entityName.hash).entity != nullEntity;
+}
+
+inline void ECSManager::removeSpecialEntity(EntityName entityName){
+    if(specialEntities.empty()){
+        return;
+    }
+    // slot keeps its hash so probing past it still works
+    SpecialEntitySlot& slot = findSpecialSlot(entityName.hash);
+    if(slot.entity != nullEntity){
+        slot.entity = nullEntity;
+        specialEntityCount--;
+    }
+}
+
+template <typename T>
+void ECSManager::addComponent(ID entityID, T component){ 
+    // check and see if object is derived from Component
+    if(is_base_of<Component,T>::value == 1){
+        // pass to component manager
+        components.addComponent<T>(entityID, component);
+        signatures.at(entityID).set(componentBit<T>());
+        // spatial index (if any) needs to pick up the new position
+        markChanged<T>(entityID);
+        notifyQueries<T>(entityID);
+    }
+}
+
+template <typename T>
+void ECSManager::addComponent(T component){ 
+    addComponent<T>(managerID, component);
+}
+
+template <typename T>
+void ECSManager::addComponents(const vector<ID>& entityIDs, const T& component){
+    // check and see if object is derived from Component
+    if constexpr (is_base_of<Component,T>::value == 1){
+        components.addComponents<T>(entityIDs, component);
+        // spatial index (if any) needs to pick up the new positions
+        for(ID entityID : entityIDs){
+            signatures.at(entityID).set(componentBit<T>());
+            markChanged<T>(entityID);
+            notifyQueries<T>(entityID);
+        }
+    }
+}
+
+template <typename T>
+void ECSManager::addComponents(const vector<ID>& entityIDs, const vector<T>& values){
+    if(entityIDs.size() != values.size()){
+        throw "error: need one component value per entity";
+    }
+    // check and see if object is derived from Component
+    if constexpr (is_base_of<Component,T>::value == 1){
+        components.addComponents<T>(entityIDs, values);
+        for(ID entityID : entityIDs){
+            signatures.at(entityID).set(componentBit<T>());
+            markChanged<T>(entityID);
+            notifyQueries<T>(entityID);
+        }
+    }
+}
+
+template <typename T>
+void ECSManager::removeComponent(ID entityID){
+    // make sure entity exists
+    if(entities.find(entityID) == entities.end()){
+        throw "error: no entity with id";
+    }
+    if(!hasComponent<T>(entityID)){
+        return;
+    }
+    // hierarchy links can't dangle, children become roots
+    if constexpr (std::is_same<T, Hierarchy>::value){
+        for(ID child : getChildren(entityID)){
+            setParent(child, nullEntity);
+        }
+        detachFromParent(getComponent<Hierarchy>(entityID));
+        hierarchyChanged = true;
+    }
+    // spatial index built over T loses the entity
+    auto found = spatialIndexes.find(typeid(T).name());
+    if(found != spatialIndexes.end()){
+        found->second->entityRemoved(entityID);
+    }
+    notifyQueriesRemoved<T>(entityID);
+    // swap and pop in storage, then clear the bit
+    components.removeComponent<T>(entityID);
+    signatures[entityID].reset(componentBit<T>());
+}
+
+template <typename... Ts>
+void ECSManager::removeComponents(ID entityID){
+    (removeComponent<Ts>(entityID), ...);
+}
+
+template <typename... Ts>
+void ECSManager::deferRemoveComponents(ID entityID){
+    defer([entityID](ECSManager& manager){
+        // entity may have been destroyed by an earlier command
+        if(manager.entities.find(entityID) != manager.entities.end()){
+            manager.removeComponents<Ts...>(entityID);
+        }
+    });
+}
+
+template <typename T>
+set<ID>& ECSManager::getComponentEntities(bool includeDisabled){
+    set<ID>& all = components.getComponentEntities<T>();
+    // nothing to hide
+    if(includeDisabled || disabledCount == 0){
+        return all;
+    }
+    return enabledEntitySet<T>().entities();
+}
+
+template <typename T>
+set<ID>& ECSManager::getNewComponentEntities(){
+    return components.getNewComponentEntities<T>();
+}
+
+template <typename T>
+void ECSManager::groupEntities(){
+    // the filtered set (if built) follows the storage's set
+    unsigned index = typeIndex<EnabledEntitySet<T>>();
+    if(index < queries.size() && queries[index]){
+        static_cast<EnabledEntitySet<T>&>(*queries[index]).grouping(components.getNewComponentEntities<T>());
+    }
+    return components.groupEntities<T>();
+}
+
+template <typename T>
+inline T& ECSManager::getComponent(ID entityID) {
+    return components.getComponent<T>(entityID);
+}
+
+template <typename T>
+inline T& ECSManager::getComponent() {
+    return getComponent<T>(managerID);
+}
+
+template <typename T>
+inline bool ECSManager::hasComponent(ID entityID) {
+    // signature bit test, no storage lookup
+    return entityID < signatures.size() && signatures[entityID].test(componentBit<T>());
+}
+
+void ECSManager::createSignature(ID entityID){
+    if(entityID >= signatures.size()){
+        signatures.resize(entityID + 1);
+    }
+    signatures[entityID] = Signature();
+    signatures[entityID].set(aliveBit);
+}
+
+void ECSManager::setMappedDirectory(const string& directory){
+    components.setMappedDirectory(directory);
+}
+
+template <typename T, typename F>
+void ECSManager::forEachComponent(F f, bool includeDisabled){
+    ComponentStorage<T>& columns = storage<T>();
+    // nothing disabled, no need to look at signatures
+    bool filter = !includeDisabled && disabledCount != 0;
+    if constexpr(std::is_same<ComponentStorage<T>, PagedVector<T>>::value){
+        columns.forEach([&](ID entityID, T& component){
+            if(!filter || isEnabled(entityID)){
+                f(entityID, component);
+            }
+        });
+    } else {
+        Span<T> values = columns.data();
+        Span<const ID> owners = columns.ids();
+        for(size_t index = 0; index < values.size(); index++){
+            if(!filter || isEnabled(owners[index])){
+                f(owners[index], values[index]);
+            }
+        }
+    }
+}
+
+template <typename T>
+ComponentStorage<T>& ECSManager::storage(){
+    static_assert(!std::is_empty<T>::value, "error: tag components have no data to span");
+    return *components.getComponentVector<T>();
+}
+
+const Signature& ECSManager::getSignature(ID entityID){
+    return signatures.at(entityID);
+}
+
+size_t ECSManager::matchSignatures(const Signature& all, const Signature& none, vector<ID>& out){
+    // dead and unused ids never match
+    Signature required = all;
+    required.set(aliveBit);
+    size_t count = signatures.size();
+    // room for every id, trimmed at the end, so the loop can append without branching
+    out.resize(count + 1);
+    size_t found = 0;
+#if defined(__AVX2__)
+    if constexpr (signatureWords % 4 == 0){
+        // 256 bits per compare
+        for(size_t entityID = 0; entityID < count; entityID++){
+            __m256i miss = _mm256_setzero_si256();
+            for(unsigned word = 0; word < signatureWords; word += 4){
+                __m256i bits = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(signatures[entityID].words + word));
+                __m256i want = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(required.words + word));
+                __m256i avoid = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(none.words + word));
+                // missing = want & ~bits, unwanted = bits & avoid
+                miss = _mm256_or_si256(miss, _mm256_andnot_si256(bits, want));
+                miss = _mm256_or_si256(miss, _mm256_and_si256(bits, avoid));
+            }
+            out[found] = entityID;
+            found += _mm256_testz_si256(miss, miss);
+        }
+        out.resize(found);
+        return found;
+    }
+#endif
+    // plain version, fixed trip count inner loop the compiler can vectorize
+    for(size_t entityID = 0; entityID < count; entityID++){
+        out[found] = entityID;
+        found += signatures[entityID].matches(required, none);
+    }
+    out.resize(found);
+    return found;
+}
+
+template <typename... Ts>
+size_t ECSManager::findEntities(vector<ID>& out, const Signature& without, bool includeDisabled){
+    Signature none = without;
+    if(!includeDisabled){
+        none.set(disabledBit);
+    }
+    return matchSignatures(makeSignature<Ts...>(), none, out);
+}
+
+void ECSManager::disable(ID entityID){
+    // make sure entity exists
+    if(entities.find(entityID) == entities.end()){
+        throw "error: no entity with id";
+    }
+    if(!isEnabled(entityID)){
+        return;
+    }
+    // just a bit, components stay where they are
+    signatures[entityID].set(disabledBit);
+    disabledCount++;
+    for(IQuery* cached : allQueries){
+        cached->entityChanged(entityID);
+    }
+}
+
+void ECSManager::enable(ID entityID){
+    // make sure entity exists
+    if(entities.find(entityID) == entities.end()){
+        throw "error: no entity with id";
+    }
+    if(isEnabled(entityID)){
+        return;
+    }
+    signatures[entityID].reset(disabledBit);
+    disabledCount--;
+    for(IQuery* cached : allQueries){
+        cached->entityChanged(entityID);
+    }
+}
+
+bool ECSManager::isEnabled(ID entityID){
+    return entityID < signatures.size() && !signatures[entityID].test(disabledBit);
+}
+
+template <typename T>
+SystemHandle ECSManager::registerSystem(){
+    // render systems draw, everything else simulates
+    if constexpr (is_base_of<RenderSystem,T>::value == 1){
+        return registerSystem<T>(Stage::Render);
+    } else {
+        return registerSystem<T>(Stage::Update);
+    }
+}
+
+template <typename T>
+SystemHandle ECSManager::registerSystem(Stage stage){
+    // check if system
+    static_assert(is_base_of<System,T>::value == 1, "registered systems must derive from System");
+#ifdef ECPPS_DEBUG
+    std::cout << typeid(T).name() << std::endl;
+#endif
+    // create system
+    unique_ptr<T> system = std::make_unique<T>();
+    SystemEntry entry;
+    // check if render system
+    if constexpr (is_base_of<RenderSystem,T>::value == 1){
+        entry.renderSystem = system.get();
+    } else {
+        entry.renderSystem = nullptr;
+    }
+    entry.system = std::move(system);
+    entry.stage = stage;
+    entry.type = typeIndex<T>();
+    entry.timers.name = profileNames.size();
+    profileNames.emplace_back(typeName<T>());
+    // next, add to vector
+    systems.emplace_back(std::move(entry));
+    scheduleChanged = true;
+    // init
+    SystemEntry& added = systems.back();
+    timeSystem(added.timers, added.timers.init, [&]{ added.system->init(this); });
+    return SystemHandle(*this, systems.size() - 1);
+}
+
+template <typename T>
+SystemHandle& SystemHandle::before(){
+    manager.systems[entry].runsBefore.emplace_back(typeIndex<T>());
+    manager.scheduleChanged = true;
+    return *this;
+}
+
+template <typename T>
+SystemHandle& SystemHandle::after(){
+    manager.systems[entry].runsAfter.emplace_back(typeIndex<T>());
+    manager.scheduleChanged = true;
+    return *this;
+}
+
+void ECSManager::buildSchedule(){
+    schedule.clear();
+    for(unsigned stage = 0; stage < stageCount; stage++){
+        stageStart[stage] = schedule.size();
+        // systems in this stage, in registration order
+        vector<unsigned> members;
+        for(unsigned i = 0; i < systems.size(); i++){
+            if(static_cast<unsigned>(systems[i].stage) == stage){
+                members.emplace_back(i);
+            }
+        }
+        // edges[a] lists members that must wait for a, waiting counts unfinished prerequisites
+        vector<vector<unsigned>> edges(members.size());
+        vector<unsigned> waiting(members.size(), 0);
+        for(unsigned a = 0; a < members.size(); a++){
+            for(unsigned b = 0; b < members.size(); b++){
+                if(a == b){
+                    continue;
+                }
+                const SystemEntry& first = systems[members[a]];
+                const SystemEntry& second = systems[members[b]];
+                // a runs before b if a says so or b says it runs after a
+                bool ordered = std::find(first.runsBefore.begin(), first.runsBefore.end(), second.type) != first.runsBefore.end()
+                    || std::find(second.runsAfter.begin(), second.runsAfter.end(), first.type) != second.runsAfter.end();
+                if(ordered){
+                    edges[a].emplace_back(b);
+                    waiting[b]++;
+                }
+            }
+        }
+        // repeatedly take the earliest registered system with nothing left to wait for
+        vector<bool> placed(members.size(), false);
+        for(unsigned count = 0; count < members.size(); count++){
+            unsigned next = members.size();
+            for(unsigned a = 0; a < members.size(); a++){
+                if(!placed[a] && waiting[a] == 0){
+                    next = a;
+                    break;
+                }
+            }
+            if(next == members.size()){
+                throw "error: system ordering constraints form a cycle";
+            }
+            placed[next] = true;
+            for(unsigned b : edges[next]){
+                waiting[b]--;
+            }
+            schedule.emplace_back(&systems[members[next]]);
+        }
+    }
+    stageStart[stageCount] = schedule.size();
+    scheduleChanged = false;
+}
+
+void ECSManager::defer(std::function<void(ECSManager&)> command){
+    deferred.emplace_back(std::move(command));
+}
+
+void ECSManager::flushDeferred(){
+    // commands may queue more commands, keep going until none are left
+    while(!deferred.empty() || concurrentCommands.load(std::memory_order_relaxed) != nullptr){
+        // take everything other threads queued, oldest first, after this thread's own
+        CommandNode* node = concurrentCommands.exchange(nullptr, std::memory_order_acquire);
+        size_t start = deferred.size();
+        while(node != nullptr){
+            CommandNode* next = node->next;
+            deferred.emplace_back(std::move(node->command));
+            delete node;
+            node = next;
+        }
+        std::reverse(deferred.begin() + start, deferred.end());
+        vector<std::function<void(ECSManager&)>> commands;
+        commands.swap(deferred);
+        for(std::function<void(ECSManager&)>& command : commands){
+            command(*this);
+        }
+    }
+}
+
+ID ECSManager::generateEntityID(){
+    // recycled if any are free, fresh otherwise
+    return idAllocator.allocate();
+}
+
+void ECSManager::deferConcurrent(std::function<void(ECSManager&)> command){
+    CommandNode* node = new CommandNode{std::move(command), nullptr};
+    // push onto the queue without locking
+    node->next = concurrentCommands.load(std::memory_order_relaxed);
+    while(!concurrentCommands.compare_exchange_weak(node->next, node, std::memory_order_release, std::memory_order_relaxed)){
+    }
+}
+
+ID ECSManager::reserveEntity(){
+    return idAllocator.reserve();
+}
+
+Entity& ECSManager::createReservedEntity(ID entityID){
+    if(entities.find(entityID) != entities.end()){
+        throw "error: reserved id is already an entity";
+    }
+    // free, never handed out or already used ids would end up live twice
+    if(!idAllocator.claimReserved(entityID)){
+        throw "error: id was not reserved";
+    }
+    return createEntityWithID<Entity>(entityID);
+}
+
+ID ECSManager::spawnConcurrent(std::function<void(ECSManager&, ID)> fill){
+    ID entityID = reserveEntity();
+    deferConcurrent([entityID, fill = std::move(fill)](ECSManager& manager){
+        manager.createReservedEntity(entityID);
+        if(fill){
+            fill(manager, entityID);
+        }
+    });
+    return entityID;
+}
+
+void ECSManager::init(){
+    // init always gets sampled when profiling, it only happens once
+    sampling = profiling;
+    if(scheduleChanged){
+        buildSchedule();
+    }
+    // init all systems in execution order
+    for(SystemEntry* entry : schedule){
+        timeSystem(entry->timers, entry->timers.init, [&]{ entry->system->init(this); });
+    }
+    flushDeferred();
+}
+
+void ECSManager::update(){
+    // decide whether this frame gets sampled (render uses the same decision)
+    sampling = profiling && (profileFrame++ % sampleRate == 0);
+    // pick up entities other worlds sent us since last frame
+    if(inbox.load(std::memory_order_relaxed) != nullptr){
+        receiveEntities();
+    }
+    // and any world partitions that finished loading
+    if(!pendingPartitions.empty()){
+        mergeStreamedPartitions();
+    }
+    if(scheduleChanged){
+        buildSchedule();
+    }
+#ifdef ECPPS_COROUTINES
+    // continue coroutines whose wait is over, anything they change is settled before systems run
+    resumeCoroutines();
+    flushDeferred();
+#endif
+    // update all systems, stage by stage
+    for(unsigned stage = static_cast<unsigned>(Stage::PreUpdate); stage <= static_cast<unsigned>(Stage::PostUpdate); stage++){
+        for(unsigned i = stageStart[stage]; i < stageStart[stage + 1]; i++){
+            SystemEntry* entry = schedule[i];
+            timeSystem(entry->timers, entry->timers.update, [&]{ entry->system->update(this); });
+        }
+        // sync point
+        flushDeferred();
+    }
+    // render systems still get their update call every frame
+    for(unsigned i = stageStart[static_cast<unsigned>(Stage::PreRender)]; i < stageStart[stageCount]; i++){
+        SystemEntry* entry = schedule[i];
+        if(entry->renderSystem != nullptr){
+            timeSystem(entry->timers, entry->timers.update, [&]{ entry->renderSystem->update(this); });
+        }
+    }
+    flushDeferred();
+    // end of frame, apply batched spatial index changes
+    flushSpatialIndexes();
+    // one more step simulated
+    simulationTime += fixedDeltaTime;
+}
+
+void ECSManager::render(){
+    if(scheduleChanged){
+        buildSchedule();
+    }
+    // render all render systems (plain systems placed in render stages get updated here instead)
+    for(unsigned stage = static_cast<unsigned>(Stage::PreRender); stage < stageCount; stage++){
+        for(unsigned i = stageStart[stage]; i < stageStart[stage + 1]; i++){
+            SystemEntry* entry = schedule[i];
+            if(entry->renderSystem != nullptr){
+                timeSystem(entry->timers, entry->timers.render, [&]{ entry->renderSystem->render(this); });
+            } else {
+                timeSystem(entry->timers, entry->timers.update, [&]{ entry->system->update(this); });
+            }
+        }
+        // sync point
+        flushDeferred();
+    }
+}
+
+MemoryStats ECSManager::memoryStats(){
+    MemoryStats stats;
+    // gather per component type numbers
+    components.memoryStats(stats);
+    // entity records, one map node each
+    stats.entityCount = entities.size();
+    stats.entityBytes = entities.size() * treeNodeBytes<std::pair<const ID, Entity>>()
+        + signatures.capacity() * sizeof(Signature)
+        + specialEntities.capacity() * sizeof(SpecialEntitySlot);
+    // ids waiting to be handed out again
+    stats.recycledIDs = idAllocator.freeIDs();
+    stats.recycledIDBytes = idAllocator.bytes();
+    stats.totalBytes = stats.componentBytes + stats.entityBytes + stats.recycledIDBytes;
+    return stats;
+}
+
+string ECSManager::checkInvariants(){
+    // check every component storage
+    string problem = components.checkInvariants(entities, signatures);
+    if(!problem.empty()){
+        return problem;
+    }
+    // every id handed out is either live, waiting to be reused or reserved, never two of those
+    ID nextID = idAllocator.issued();
+    vector<bool> seen(nextID, false);
+    for(const auto& [key, value] : entities){
+        if(key >= nextID){
+            return "entity " + std::to_string(key) + " was never handed out";
+        }
+        if(value.getID() != key){
+            return "entity " + std::to_string(key) + " is stored with id " + std::to_string(value.getID());
+        }
+        if(key >= signatures.size() || !signatures[key].test(aliveBit)){
+            return "entity " + std::to_string(key) + " is live but not marked alive";
+        }
+        seen[key] = true;
+    }
+    size_t recycled = 0;
+    idAllocator.forEachFree([&](ID id){
+        recycled++;
+        if(!problem.empty()){
+            return;
+        }
+        if(id >= nextID){
+            problem = "recycled id " + std::to_string(id) + " was never handed out";
+        } else if(seen[id]){
+            problem = "id " + std::to_string(id) + " is recycled but still in use (or recycled twice)";
+        } else {
+            seen[id] = true;
+        }
+    });
+    if(!problem.empty()){
+        return problem;
+    }
+    if(recycled != idAllocator.freeIDs()){
+        return "free id count is " + std::to_string(idAllocator.freeIDs()) + " but " + std::to_string(recycled) + " ids are free";
+    }
+    // special entity names only point at live entities
+    for(const SpecialEntitySlot& slot : specialEntities){
+        if(slot.entity != nullEntity && entities.find(slot.entity) == entities.end()){
+            return "special entity name points at destroyed entity " + std::to_string(slot.entity);
+        }
+    }
+    size_t disabled = 0;
+    for(const auto& [key, value] : entities){
+        disabled += !isEnabled(key);
+    }
+    if(disabled != disabledCount){
+        return "disabled count is " + std::to_string(disabledCount) + " but " + std::to_string(disabled) + " entities are disabled";
+    }
+    // parked pool entities are live, disabled and parked exactly once
+    vector<bool> inPool(nextID, false);
+    size_t pooledCount = 0;
+    for(const auto& [key, value] : prefabs){
+        for(ID entityID : value.pool){
+            if(entities.find(entityID) == entities.end()){
+                return "prefab " + key + " pools destroyed entity " + std::to_string(entityID);
+            }
+            if(inPool[entityID]){
+                return "entity " + std::to_string(entityID) + " is in a prefab pool more than once";
+            }
+            inPool[entityID] = true;
+            pooledCount++;
+            if(entityID >= parked.size() || !parked[entityID]){
+                return "prefab " + key + " pools entity " + std::to_string(entityID) + " that isn't marked parked";
+            }
+            if(isEnabled(entityID)){
+                return "prefab " + key + " pools entity " + std::to_string(entityID) + " that is still enabled";
+            }
+        }
+    }
+    if(static_cast<size_t>(std::count(parked.begin(), parked.end(), true)) != pooledCount){
+        return "an entity is marked parked but isn't in any prefab pool";
+    }
+    size_t accounted = entities.size() + recycled + idAllocator.reservedIDs();
+    if(accounted != nextID){
+        return "ids have leaked: " + std::to_string(nextID - accounted) + " neither live, recycled nor reserved";
+    }
+    return "";
+}
+
+// ------- ID allocation ------- //
+
+IDAllocator::IDAllocator(){
+    static std::atomic<uint64_t> serials{1};
+    serial = serials.fetch_add(1, std::memory_order_relaxed);
+    for(std::atomic<std::atomic<ID>*>& chunk : chunks){
+        chunk.store(nullptr, std::memory_order_relaxed);
+    }
+    Registry& shared = registry();
+    std::lock_guard<std::mutex> lock(shared.mutex);
+    shared.live.emplace(serial, this);
+}
+
+IDAllocator::~IDAllocator(){
+    // threads exiting after this keep their leftover ids to themselves
+    {
+        Registry& shared = registry();
+        std::lock_guard<std::mutex> lock(shared.mutex);
+        shared.live.erase(serial);
+    }
+    for(std::atomic<std::atomic<ID>*>& chunk : chunks){
+        delete[] chunk.load(std::memory_order_relaxed);
+    }
+}
+
+std::atomic<ID>& IDAllocator::slot(ID entityID){
+    // chunk k covers firstChunkSize * (2^k - 1) up to firstChunkSize * (2^(k+1) - 1)
+    unsigned chunk = highestBit(entityID / firstChunkSize + 1);
+    size_t offset = entityID - firstChunkSize * ((size_t(1) << chunk) - 1);
+    std::atomic<ID>* links = chunks[chunk].load(std::memory_order_acquire);
+    if(links == nullptr){
+        // first use, whoever loses the race frees theirs
+        // zeroed, so no slot reads as reserved before reserve marks it
+        std::atomic<ID>* created = new std::atomic<ID>[firstChunkSize << chunk]();
+        if(chunks[chunk].compare_exchange_strong(links, created, std::memory_order_acq_rel, std::memory_order_acquire)){
+            links = created;
+        } else {
+            delete[] created;
+        }
+    }
+    return links[offset];
+}
+
+ID IDAllocator::takeFresh(ID count){
+    ID first = nextID.fetch_add(count, std::memory_order_acq_rel);
+    // nullEntity and above are never handed out
+    if(first >= nullEntity - count){
+        throw "error: out of entity ids";
+    }
+    return first;
+}
+
+ID IDAllocator::allocate(){
+    uint64_t head = freeHead.load(std::memory_order_acquire);
+    while(static_cast<ID>(head) != nullEntity){
+        ID top = static_cast<ID>(head);
+        // new head is the id below, with the change counter bumped
+        uint64_t next = (((head >> 32) + 1) << 32) | slot(top).load(std::memory_order_relaxed);
+        if(freeHead.compare_exchange_weak(head, next, std::memory_order_acquire, std::memory_order_acquire)){
+            freeCount.fetch_sub(1, std::memory_order_relaxed);
+            return top;
+        }
+    }
+    // nothing to recycle
+    return takeFresh(1);
+}
+
+IDAllocator::Registry& IDAllocator::registry(){
+    static Registry shared;
+    return shared;
+}
+
+IDAllocator::ThreadBlocks::~ThreadBlocks(){
+    Registry& shared = registry();
+    std::lock_guard<std::mutex> lock(shared.mutex);
+    for(const ReservedBlock& block : blocks){
+        auto found = shared.live.find(block.owner);
+        if(found != shared.live.end() && block.next != block.end){
+            found->second->returnReserved(block.next, block.end);
+        }
+    }
+}
+
+ID IDAllocator::reserve(){
+    thread_local ThreadBlocks held;
+    ReservedBlock* block = nullptr;
+    for(ReservedBlock& candidate : held.blocks){
+        if(candidate.owner == serial){
+            block = &candidate;
+            break;
+        }
+    }
+    if(block == nullptr){
+        // first reserve from this allocator on this thread, drop blocks of allocators that are gone
+        Registry& shared = registry();
+        std::lock_guard<std::mutex> lock(shared.mutex);
+        held.blocks.erase(std::remove_if(held.blocks.begin(), held.blocks.end(), [&](const ReservedBlock& stale){
+            return shared.live.find(stale.owner) == shared.live.end();
+        }), held.blocks.end());
+        held.blocks.emplace_back(ReservedBlock{serial, 0, 0});
+        block = &held.blocks.back();
+    }
+    if(block->next == block->end){
+        ID first = takeFresh(ECPPS_ID_BLOCK);
+        reservedCount.fetch_add(ECPPS_ID_BLOCK, std::memory_order_relaxed);
+        *block = ReservedBlock{serial, first, static_cast<ID>(first + ECPPS_ID_BLOCK)};
+    }
+    ID entityID = block->next++;
+    // lets claimReserved tell this id apart from free or never reserved ones
+    slot(entityID).store(reservedLink, std::memory_order_release);
+    return entityID;
+}
+
+bool IDAllocator::claimReserved(ID entityID){
+    if(entityID >= issued()){
+        return false;
+    }
+    // only one claim can win, and free ids hold a real link so they never match
+    ID expected = reservedLink;
+    if(!slot(entityID).compare_exchange_strong(expected, nullEntity, std::memory_order_acq_rel, std::memory_order_acquire)){
+        return false;
+    }
+    reservedCount.fetch_sub(1, std::memory_order_relaxed);
+    return true;
+}
+
+void IDAllocator::returnReserved(ID first, ID end){
+    for(ID entityID = first; entityID != end; entityID++){
+        release(entityID);
+    }
+    reservedCount.fetch_sub(end - first, std::memory_order_relaxed);
+}
+
+void IDAllocator::release(ID entityID){
+    std::atomic<ID>& link = slot(entityID);
+    uint64_t head = freeHead.load(std::memory_order_relaxed);
+    uint64_t next;
+    do {
+        // link to the current top, then try to become the top
+        link.store(static_cast<ID>(head), std::memory_order_relaxed);
+        next = (((head >> 32) + 1) << 32) | entityID;
+    } while(!freeHead.compare_exchange_weak(head, next, std::memory_order_release, std::memory_order_relaxed));
+    freeCount.fetch_add(1, std::memory_order_relaxed);
+}
+
+size_t IDAllocator::bytes() const {
+    size_t total = 0;
+    for(unsigned chunk = 0; chunk < chunkCount; chunk++){
+        if(chunks[chunk].load(std::memory_order_relaxed) != nullptr){
+            total += (firstChunkSize << chunk) * sizeof(std::atomic<ID>);
+        }
+    }
+    return total;
+}
+
+template <typename F>
+void IDAllocator::forEachFree(F f){
+    ID entityID = static_cast<ID>(freeHead.load(std::memory_order_acquire));
+    while(entityID != nullEntity){
+        f(entityID);
+        entityID = slot(entityID).load(std::memory_order_relaxed);
+    }
+}
+
+// ------- Transfers ------- //
+
+template <typename T>
+void ComponentPacket<T>::insert(ECSManager& manager, ID entityID){
+    manager.addComponent<T>(entityID, std::move(component));
+}
+
+EntityPacket ECSManager::extractEntity(ID entityID){
+    // make sure entity exists
+    if(entities.find(entityID) == entities.end()){
+        throw "error: no entity with id";
+    }
+    // hierarchy links only make sense inside this world
+    if(hasComponent<Hierarchy>(entityID)){
+        for(ID child : getChildren(entityID)){
+            setParent(child, nullEntity);
+        }
+        detachFromParent(getComponent<Hierarchy>(entityID));
+        components.getComponentVector<Hierarchy>()->removeEntity(entityID);
+        signatures[entityID].reset(componentBit<Hierarchy>());
+        hierarchyChanged = true;
+    }
+    // pack up all other components
+    EntityPacket packet;
+    components.extractEntity(entityID, packet);
+    // clear out what's left of the entity (names, spatial indexes, id)
+    destroyEntity(entityID);
+    return packet;
+}
+
+ID ECSManager::insertEntity(EntityPacket packet){
+    ID entityID = createEntity().getID();
+    for(unique_ptr<IComponentPacket>& component : packet.components){
+        component->insert(*this, entityID);
+    }
+    return entityID;
+}
+
+void ECSManager::sendEntity(ID entityID, ECSManager& destination){
+    // pack up on this (the source) thread
+    TransferNode* node = new TransferNode{extractEntity(entityID), nullptr};
+    // push onto destination's queue without locking
+    node->next = destination.inbox.load(std::memory_order_relaxed);
+    while(!destination.inbox.compare_exchange_weak(node->next, node, std::memory_order_release, std::memory_order_relaxed)){
+    }
+}
+
+vector<ID> ECSManager::receiveEntities(){
+    // take the whole queue in one go
+    TransferNode* node = inbox.exchange(nullptr, std::memory_order_acquire);
+    // queue is newest first, flip it so entities arrive in send order
+    TransferNode* ordered = nullptr;
+    while(node != nullptr){
+        TransferNode* next = node->next;
+        node->next = ordered;
+        ordered = node;
+        node = next;
+    }
+    vector<ID> received;
+    while(ordered != nullptr){
+        TransferNode* next = ordered->next;
+        received.emplace_back(insertEntity(std::move(ordered->packet)));
+        delete ordered;
+        ordered = next;
+    }
+    return received;
+}
+
+// moves an entity (and all of its components) from one world to another right away, returns its id in destination
+// both worlds must be idle (use sendEntity when destination is ticking on another thread)
+inline ID transferEntity(ECSManager& source, ID entityID, ECSManager& destination){
+    return destination.insertEntity(source.extractEntity(entityID));
+}
+
+// batched version of transferEntity, returns the new ids in the same order
+inline vector<ID> transferEntities(ECSManager& source, const vector<ID>& entityIDs, ECSManager& destination){
+    vector<ID> moved;
+    moved.reserve(entityIDs.size());
+    for(ID entityID : entityIDs){
+        moved.emplace_back(destination.insertEntity(source.extractEntity(entityID)));
+    }
+    return moved;
+}
+
+// ------- Partitions ------- //
+
+template <typename T>
+void StreamCodec<T>::save(ECSManager& manager, const vector<ID>& entityIDs, const std::function<ID(ID)>& toLocal, StagedColumn& column){
+    column.typeHash = hashName(typeName<T>());
+    column.elementSize = sizeof(T);
+    for(uint32_t local = 0; local < entityIDs.size(); local++){
+        if(!manager.hasComponent<T>(entityIDs[local])){
+            continue;
+        }
+        T value = manager.getComponent<T>(entityIDs[local]);
+        // ids inside the component become partition indexes
+        if(remapIDs){
+            remapIDs(value, toLocal);
+        }
+        column.entities.emplace_back(local);
+        const unsigned char* raw = reinterpret_cast<const unsigned char*>(&value);
+        column.bytes.insert(column.bytes.end(), raw, raw + sizeof(T));
+    }
+}
+
+template <typename T>
+void StreamCodec<T>::validate(const StagedColumn& column, uint32_t entityCount){
+    if(column.elementSize != sizeof(T) || column.bytes.size() != column.entities.size() * sizeof(T)){
+        throw "error: partition column does not match its component type";
+    }
+    for(uint32_t local : column.entities){
+        if(local >= entityCount){
+            throw "error: partition column names an entity outside the partition";
+        }
+    }
+}
+
+template <typename T>
+void StreamCodec<T>::merge(ECSManager& manager, const StagedColumn& column, const vector<ID>& entityIDs){
+    auto toWorld = [&](ID local){ return local < entityIDs.size() ? entityIDs[local] : nullEntity; };
+    // gather the whole column, then insert it in one go
+    vector<ID> owners;
+    vector<T> values(column.entities.size());
+    owners.reserve(column.entities.size());
+    std::memcpy(static_cast<void*>(values.data()), column.bytes.data(), column.bytes.size());
+    for(size_t i = 0; i < column.entities.size(); i++){
+        owners.emplace_back(entityIDs[column.entities[i]]);
+        // partition indexes inside the component become live ids
+        if(remapIDs){
+            remapIDs(values[i], toWorld);
+        }
+    }
+    manager.addComponents<T>(owners, values);
+}
+
+// file layout: magic, entity count, parent index per entity, column count,
+// then per column: type hash, element size, value count, entity indexes, raw values
+StagedPartition readPartition(const string& path){
+    std::ifstream in(path, std::ios::binary);
+    if(!in){
+        throw "error: could not open partition file";
+    }
+    auto read = [&](void* target, size_t bytes){
+        if(bytes != 0 && !in.read(static_cast<char*>(target), bytes)){
+            throw "error: partition file is truncated";
+        }
+    };
+    uint64_t magic = 0;
+    read(&magic, sizeof(magic));
+    if(magic != hashName("ecpps partition")){
+        throw "error: not a partition file";
+    }
+    StagedPartition staged;
+    read(&staged.entityCount, sizeof(staged.entityCount));
+    staged.parents.resize(staged.entityCount);
+    read(staged.parents.data(), staged.entityCount * sizeof(uint32_t));
+    uint32_t columnCount = 0;
+    read(&columnCount, sizeof(columnCount));
+    staged.columns.resize(columnCount);
+    for(StagedColumn& column : staged.columns){
+        uint32_t count = 0;
+        read(&column.typeHash, sizeof(column.typeHash));
+        read(&column.elementSize, sizeof(column.elementSize));
+        read(&count, sizeof(count));
+        column.entities.resize(count);
+        read(column.entities.data(), count * sizeof(uint32_t));
+        column.bytes.resize(size_t(count) * column.elementSize);
+        read(column.bytes.data(), column.bytes.size());
+    }
+    return staged;
+}
+
+template <typename T>
+void ECSManager::registerStreamable(std::function<void(T&, const std::function<ID(ID)>&)> remapIDs){
+    static_assert(std::is_trivially_copyable<T>::value, "error: streamable components must be trivially copyable");
+    // hierarchy links are saved separately, as parent indexes
+    static_assert(!std::is_same<T, Hierarchy>::value, "error: hierarchy is streamed automatically");
+    streamCodecs[hashName(typeName<T>())] = std::make_unique<StreamCodec<T>>(std::move(remapIDs));
+}
+
+void ECSManager::savePartition(const string& path, const vector<ID>& entityIDs){
+    // live id -> partition index
+    std::unordered_map<ID, ID> locals;
+    for(ID local = 0; local < entityIDs.size(); local++){
+        locals[entityIDs[local]] = local;
+    }
+    auto toLocal = [&](ID entityID){
+        auto found = locals.find(entityID);
+        return found == locals.end() ? nullEntity : found->second;
+    };
+    // parents outside the group are dropped, those entities load as roots
+    vector<uint32_t> parents(entityIDs.size(), nullEntity);
+    for(size_t local = 0; local < entityIDs.size(); local++){
+        if(hasComponent<Hierarchy>(entityIDs[local])){
+            parents[local] = toLocal(getComponent<Hierarchy>(entityIDs[local]).parent);
+        }
+    }
+    vector<StagedColumn> columns;
+    for(const auto& [key, value] : streamCodecs){
+        StagedColumn column;
+        value->save(*this, entityIDs, toLocal, column);
+        if(!column.entities.empty()){
+            columns.emplace_back(std::move(column));
+        }
+    }
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    if(!out){
+        throw "error: could not open partition file";
+    }
+    auto write = [&](const void* source, size_t bytes){
+        out.write(static_cast<const char*>(source), bytes);
+    };
+    uint64_t magic = hashName("ecpps partition");
+    uint32_t entityCount = entityIDs.size();
+    uint32_t columnCount = columns.size();
+    write(&magic, sizeof(magic));
+    write(&entityCount, sizeof(entityCount));
+    write(parents.data(), parents.size() * sizeof(uint32_t));
+    write(&columnCount, sizeof(columnCount));
+    for(const StagedColumn& column : columns){
+        uint32_t count = column.entities.size();
+        write(&column.typeHash, sizeof(column.typeHash));
+        write(&column.elementSize, sizeof(column.elementSize));
+        write(&count, sizeof(count));
+        write(column.entities.data(), count * sizeof(uint32_t));
+        write(column.bytes.data(), column.bytes.size());
+    }
+    if(!out){
+        throw "error: could not write partition file";
+    }
+}
+
+void ECSManager::streamPartition(const string& name, const string& path){
+    if(isPartitionLoaded(name)){
+        throw "error: partition already loaded";
+    }
+    // decoding happens off this thread, the manager isn't touched until the merge
+    pendingPartitions.emplace_back(PendingPartition{name, std::async(std::launch::async, readPartition, path)});
+}
+
+size_t ECSManager::mergeStreamedPartitions(){
+    size_t merged = 0;
+    for(size_t i = 0; i < pendingPartitions.size();){
+        PendingPartition& pending = pendingPartitions[i];
+        // still loading, check again next frame
+        if(pending.staged.wait_for(std::chrono::seconds(0)) != std::future_status::ready){
+            i++;
+            continue;
+        }
+        PendingPartition done = std::move(pending);
+        pendingPartitions.erase(pendingPartitions.begin() + i);
+        // rethrows anything the loader thread threw
+        mergePartition(done.name, done.staged.get());
+        merged++;
+    }
+    return merged;
+}
+
+const vector<ID>& ECSManager::mergePartition(const string& name, const StagedPartition& staged){
+    if(isPartitionLoaded(name)){
+        throw "error: partition already loaded";
+    }
+    // check everything up front, a bad partition must not leave half its entities behind
+    if(staged.parents.size() != staged.entityCount){
+        throw "error: partition parent list does not match its entity count";
+    }
+    for(const StagedColumn& column : staged.columns){
+        auto codec = streamCodecs.find(column.typeHash);
+        if(codec == streamCodecs.end()){
+            throw "error: partition holds a component type that isn't registered as streamable";
+        }
+        codec->second->validate(column, staged.entityCount);
+    }
+    // parents must be inside the partition and never loop back (0 unvisited, 1 on the current path, 2 fine)
+    vector<char> state(staged.entityCount, 0);
+    vector<uint32_t> path;
+    for(uint32_t first = 0; first < staged.entityCount; first++){
+        uint32_t local = first;
+        while(local != nullEntity && state[local] == 0){
+            state[local] = 1;
+            path.emplace_back(local);
+            local = staged.parents[local];
+            if(local != nullEntity && local >= staged.entityCount){
+                throw "error: partition entity has a parent outside the partition";
+            }
+        }
+        if(local != nullEntity && state[local] == 1){
+            throw "error: partition hierarchy has a loop";
+        }
+        for(uint32_t visited : path){
+            state[visited] = 2;
+        }
+        path.clear();
+    }
+    auto loaded = partitions.emplace(name, vector<ID>()).first;
+    vector<ID>& entityIDs = loaded->second;
+    // all the entities first, partition index i becomes entityIDs[i]
+    entityIDs.reserve(staged.entityCount);
+    for(uint32_t i = 0; i < staged.entityCount; i++){
+        entityIDs.emplace_back(createEntity().getID());
+    }
+    if(partitionOwners.size() < idAllocator.issued()){
+        partitionOwners.resize(idAllocator.issued(), nullptr);
+    }
+    for(ID entityID : entityIDs){
+        partitionOwners[entityID] = &loaded->first;
+    }
+    // then each component type a column at a time
+    for(const StagedColumn& column : staged.columns){
+        streamCodecs.at(column.typeHash)->merge(*this, column, entityIDs);
+    }
+    // and the hierarchy inside the partition
+    for(uint32_t i = 0; i < staged.entityCount; i++){
+        if(staged.parents[i] != nullEntity){
+            setParent(entityIDs[i], entityIDs[staged.parents[i]]);
+        }
+    }
+    return entityIDs;
+}
+
+void ECSManager::unloadPartition(const string& name){
+    auto found = partitions.find(name);
+    if(found == partitions.end()){
+        throw "error: no partition with name";
+    }
+    // skip anything already destroyed, its id may belong to someone else now
+    vector<ID> owned;
+    owned.reserve(found->second.size());
+    for(ID entityID : found->second){
+        if(entityID < partitionOwners.size() && partitionOwners[entityID] == &found->first){
+            owned.emplace_back(entityID);
+        }
+    }
+    destroyEntities(owned);
+    partitions.erase(found);
+}
+
+bool ECSManager::isPartitionLoaded(const string& name){
+    if(partitions.find(name) != partitions.end()){
+        return true;
+    }
+    for(const PendingPartition& pending : pendingPartitions){
+        if(pending.name == name){
+            return true;
+        }
+    }
+    return false;
+}
+
+// ------- Queries ------- //
+
+bool QueryBase::contains(ID entityID) const {
+    return entityID < positions.size() && positions[entityID] != nullEntity;
+}
+
+void QueryBase::insert(ID entityID){
+    if(contains(entityID)){
+        return;
+    }
+    // grow position table to cover the id
+    if(entityID >= positions.size()){
+        positions.resize(entityID + 1, nullEntity);
+    }
+    positions[entityID] = matches.size();
+    matches.emplace_back(entityID);
+}
+
+void QueryBase::erase(ID entityID){
+    if(!contains(entityID)){
+        return;
+    }
+    // swap and pop, fixing up the moved entity's slot
+    unsigned slot = positions[entityID];
+    ID moved = matches.back();
+    matches[slot] = moved;
+    positions[moved] = slot;
+    matches.pop_back();
+    positions[entityID] = nullEntity;
+}
+
+void QueryBase::entityRemoved(ID entityID){
+    erase(entityID);
+}
+
+template <typename... Ts>
+Query<Ts...>::Query(ComponentManager& components, const vector<Signature>& signatures, bool includeDisabled)
+    : storages(components.getComponentVector<Ts>()...), signatures(signatures), mask(makeSignature<Ts...>()) {
+    if(!includeDisabled){
+        excluded.set(disabledBit);
+    }
+}
+
+template <typename... Ts>
+bool Query<Ts...>::isMatch(ID entityID){
+    return entityID < signatures.size() && signatures[entityID].matches(mask, excluded);
+}
+
+template <typename... Ts>
+void Query<Ts...>::entityChanged(ID entityID){
+    bool matched = isMatch(entityID);
+    if(matched && !contains(entityID)){
+        insert(entityID);
+    } else if(!matched){
+        erase(entityID);
+    }
+}
+
+template <typename... Ts>
+void Query<Ts...>::componentAdded(ID entityID){
+    if(!contains(entityID) && isMatch(entityID)){
+        insert(entityID);
+    }
+}
+
+template <typename... Ts>
+template <typename F>
+void Query<Ts...>::each(F f){
+    for(ID entityID : matches){
+        f(entityID, std::get<std::shared_ptr<ComponentStorage<Ts>>>(storages)->getComponent(entityID)...);
+    }
+}
+
+template <typename T>
+EnabledEntitySet<T>::EnabledEntitySet(ComponentManager& components, const vector<Signature>& signatures)
+    : storage(components.getComponentVector<T>()), signatures(signatures) {
+    for(ID entityID : storage->getComponentEntities()){
+        if(!signatures[entityID].test(disabledBit)){
+            members.emplace_hint(members.end(), entityID);
+        }
+    }
+}
+
+template <typename T>
+void EnabledEntitySet<T>::componentAdded(ID entityID){
+    // new components only join the storage's set when they are grouped
+    if(!signatures[entityID].test(disabledBit) && storage->getNewComponentEntities().count(entityID) == 0){
+        members.emplace(entityID);
+    }
+}
+
+template <typename T>
+void EnabledEntitySet<T>::entityRemoved(ID entityID){
+    members.erase(entityID);
+}
+
+template <typename T>
+void EnabledEntitySet<T>::entityChanged(ID entityID){
+    if(signatures[entityID].test(disabledBit) || !signatures[entityID].test(componentBit<T>())){
+        members.erase(entityID);
+    } else {
+        componentAdded(entityID);
+    }
+}
+
+template <typename T>
+void EnabledEntitySet<T>::grouping(const set<ID>& newEntities){
+    for(ID entityID : newEntities){
+        if(!signatures[entityID].test(disabledBit)){
+            members.emplace(entityID);
+        }
+    }
+}
+
+template <typename T>
+EnabledEntitySet<T>& ECSManager::enabledEntitySet(){
+    unsigned index = typeIndex<EnabledEntitySet<T>>();
+    if(index >= queries.size()){
+        queries.resize(index + 1);
+    }
+    if(queries[index]){
+        return static_cast<EnabledEntitySet<T>&>(*queries[index]);
+    }
+    // registered like a query so adds, removals, destroys and enable/disable reach it
+    auto created = std::make_unique<EnabledEntitySet<T>>(components, signatures);
+    EnabledEntitySet<T>* cached = created.get();
+    unsigned componentType = typeIndex<T>();
+    if(componentType >= queriesByComponent.size()){
+        queriesByComponent.resize(componentType + 1);
+    }
+    queriesByComponent[componentType].emplace_back(cached);
+    allQueries.emplace_back(cached);
+    queries[index] = std::move(created);
+    return *cached;
+}
+
+template <typename... Ts>
+Query<Ts...>& ECSManager::query(){
+    return cachedQuery<Ts...>(typeIndex<Query<Ts...>>(), false);
+}
+
+template <typename... Ts>
+Query<Ts...>& ECSManager::queryIncludingDisabled(){
+    // separate cache slot from the filtered query over the same components
+    return cachedQuery<Ts...>(typeIndex<DisabledQueryKey<Ts...>>(), true);
+}
+
+template <typename... Ts>
+Query<Ts...>& ECSManager::cachedQuery(unsigned index, bool includeDisabled){
+    if(index >= queries.size()){
+        queries.resize(index + 1);
+    }
+    // already built, just hand it back
+    if(queries[index]){
+        return static_cast<Query<Ts...>&>(*queries[index]);
+    }
+    auto created = std::make_unique<Query<Ts...>>(components, signatures, includeDisabled);
+    Query<Ts...>* cached = created.get();
+    // fill with everything that already matches
+    for(const auto& [key, value] : entities){
+        cached->componentAdded(key);
+    }
+    // register for updates on each component type it looks at
+    for(unsigned componentType : {typeIndex<Ts>()...}){
+        if(componentType >= queriesByComponent.size()){
+            queriesByComponent.resize(componentType + 1);
+        }
+        queriesByComponent[componentType].emplace_back(cached);
+    }
+    allQueries.emplace_back(cached);
+    queries[index] = std::move(created);
+    return *cached;
+}
+
+template <typename T>
+void ECSManager::notifyQueriesRemoved(ID entityID){
+    unsigned componentType = typeIndex<T>();
+    if(componentType < queriesByComponent.size()){
+        for(IQuery* cached : queriesByComponent[componentType]){
+            cached->entityRemoved(entityID);
+        }
+    }
+}
+
+template <typename T>
+void ECSManager::notifyQueries(ID entityID){
+    unsigned componentType = typeIndex<T>();
+    if(componentType < queriesByComponent.size()){
+        for(IQuery* cached : queriesByComponent[componentType]){
+            cached->componentAdded(entityID);
+        }
+    }
+}
+
+// ------- Resources ------- //
+
+template <typename T>
+T& ECSManager::insertResource(T resource){
+    unsigned index = typeIndex<T>();
+    // grow slot list to cover the type
+    if(index >= resources.size()){
+        resources.resize(index + 1);
+    }
+    resources[index] = std::make_shared<T>(std::move(resource));
+    return *static_cast<T*>(resources[index].get());
+}
+
+template <typename T>
+T& ECSManager::resource(){
+    unsigned index = typeIndex<T>();
+    if(index >= resources.size() || !resources[index]){
+        throw "error: no resource of type";
+    }
+    return *static_cast<T*>(resources[index].get());
+}
+
+template <typename T>
+bool ECSManager::hasResource(){
+    unsigned index = typeIndex<T>();
+    return index < resources.size() && resources[index];
+}
+
+template <typename T>
+void ECSManager::removeResource(){
+    unsigned index = typeIndex<T>();
+    if(index < resources.size()){
+        resources[index].reset();
+    }
+}
+
+// ------- Hierarchy ------- //
+
+void ECSManager::setParent(ID child, ID parent){
+    // can't attach to self or to something that's already below us
+    for(ID ancestor = parent; ancestor != nullEntity; ancestor = getParent(ancestor)){
+        if(ancestor == child){
+            throw "error: hierarchy would contain a cycle";
+        }
+    }
+    // make sure both ends have hierarchy links
+    if(!hasComponent<Hierarchy>(child)){
+        addComponent<Hierarchy>(child, Hierarchy());
+    }
+    if(parent != nullEntity && !hasComponent<Hierarchy>(parent)){
+        addComponent<Hierarchy>(parent, Hierarchy());
+    }
+    // unlink from old parent
+    detachFromParent(getComponent<Hierarchy>(child));
+    // link in at the front of the new parent's child list
+    if(parent != nullEntity){
+        Hierarchy& parentNode = getComponent<Hierarchy>(parent);
+        Hierarchy& childNode = getComponent<Hierarchy>(child);
+        childNode.parent = parent;
+        childNode.nextSibling = parentNode.firstChild;
+        if(parentNode.firstChild != nullEntity){
+            getComponent<Hierarchy>(parentNode.firstChild).prevSibling = child;
+        }
+        parentNode.firstChild = child;
+        updateDepth(child, parentNode.depth + 1);
+    } else {
+        updateDepth(child, 0);
+    }
+    // world transform depends on the new parent
+    getComponent<Hierarchy>(child).dirty = true;
+    hierarchyChanged = true;
+}
+
+ID ECSManager::getParent(ID entityID){
+    if(!hasComponent<Hierarchy>(entityID)){
+        return nullEntity;
+    }
+    return getComponent<Hierarchy>(entityID).parent;
+}
+
+vector<ID> ECSManager::getChildren(ID entityID){
+    vector<ID> children;
+    if(hasComponent<Hierarchy>(entityID)){
+        // walk sibling list
+        for(ID child = getComponent<Hierarchy>(entityID).firstChild; child != nullEntity;
+            child = getComponent<Hierarchy>(child).nextSibling){
+            children.emplace_back(child);
+        }
+    }
+    return children;
+}
+
+void ECSManager::markTransformDirty(ID entityID){
+    getComponent<Hierarchy>(entityID).dirty = true;
+}
+
+void ECSManager::detachFromParent(Hierarchy& node){
+    if(node.parent == nullEntity){
+        return;
+    }
+    // patch neighbours (or parent's head) around this entity
+    if(node.prevSibling != nullEntity){
+        getComponent<Hierarchy>(node.prevSibling).nextSibling = node.nextSibling;
+    } else {
+        getComponent<Hierarchy>(node.parent).firstChild = node.nextSibling;
+    }
+    if(node.nextSibling != nullEntity){
+        getComponent<Hierarchy>(node.nextSibling).prevSibling = node.prevSibling;
+    }
+    node.parent = nullEntity;
+    node.nextSibling = nullEntity;
+    node.prevSibling = nullEntity;
+}
+
+void ECSManager::updateDepth(ID entityID, unsigned depth){
+    Hierarchy& node = getComponent<Hierarchy>(entityID);
+    node.depth = depth;
+    for(ID child = node.firstChild; child != nullEntity; child = getComponent<Hierarchy>(child).nextSibling){
+        updateDepth(child, depth + 1);
+    }
+}
+
+void ECSManager::rebuildHierarchyOrder(){
+    // gather every entity with hierarchy links
+    vector<ID> members;
+    for(ID entityID : getNewComponentEntities<Hierarchy>()){
+        members.emplace_back(entityID);
+    }
+    for(ID entityID : getComponentEntities<Hierarchy>(true)){
+        members.emplace_back(entityID);
+    }
+    // counting sort by depth, so every parent lands before its children
+    vector<unsigned> depthCounts;
+    for(ID entityID : members){
+        unsigned depth = getComponent<Hierarchy>(entityID).depth;
+        if(depth >= depthCounts.size()){
+            depthCounts.resize(depth + 1, 0);
+        }
+        depthCounts[depth]++;
+    }
+    vector<unsigned> depthStart(depthCounts.size(), 0);
+    for(unsigned depth = 1; depth < depthCounts.size(); depth++){
+        depthStart[depth] = depthStart[depth - 1] + depthCounts[depth - 1];
+    }
+    hierarchyOrder.assign(members.size(), HierarchyNode{nullEntity, 0, nullptr});
+    vector<ID> order(members.size(), nullEntity);
+    vector<unsigned> slotOf(idAllocator.issued(), 0);
+    for(ID entityID : members){
+        unsigned slot = depthStart[getComponent<Hierarchy>(entityID).depth]++;
+        hierarchyOrder[slot].entity = entityID;
+        order[slot] = entityID;
+        slotOf[entityID] = slot;
+    }
+    // store the links in the same order, so propagation walks them front to back
+    auto storage = components.getComponentVector<Hierarchy>();
+    reorderStorage(*storage, order);
+    // remember where each parent sits so propagation never has to search for it
+    for(HierarchyNode& node : hierarchyOrder){
+        node.links = &storage->getComponent(node.entity);
+        ID parent = node.links->parent;
+        node.parentSlot = parent == nullEntity ? static_cast<unsigned>(-1) : slotOf[parent];
+    }
+    hierarchyLayout = storage->structureVersion();
+    hierarchyOrderVersion++;
+    hierarchyChanged = false;
+}
+
+template <typename Local, typename World, typename F>
+void ECSManager::propagateTransforms(F combine){
+    // added or removed links move the others, so their cached pointers go stale too
+    if(hierarchyChanged || components.getComponentVector<Hierarchy>()->structureVersion() != hierarchyLayout){
+        rebuildHierarchyOrder();
+    }
+    unsigned index = typeIndex<TransformSlots<Local, World>>();
+    if(index >= transformSlots.size()){
+        transformSlots.resize(index + 1);
+    }
+    if(!transformSlots[index]){
+        transformSlots[index] = std::make_shared<TransformSlots<Local, World>>();
+    }
+    TransformSlots<Local, World>& slots = *static_cast<TransformSlots<Local, World>*>(transformSlots[index].get());
+    auto locals = components.getComponentVector<Local>();
+    auto worlds = components.getComponentVector<World>();
+    // resolve every slot's Local and World once, and again only after something moved
+    if(slots.locals.size() != hierarchyOrder.size() || slots.orderVersion != hierarchyOrderVersion
+        || slots.localVersion != locals->structureVersion() || slots.worldVersion != worlds->structureVersion()){
+        vector<ID> order;
+        order.reserve(hierarchyOrder.size());
+        for(const HierarchyNode& node : hierarchyOrder){
+            order.emplace_back(node.entity);
+        }
+        // same order as the hierarchy, so the pass below reads both front to back
+        reorderStorage(*locals, order);
+        reorderStorage(*worlds, order);
+        slots.locals.assign(hierarchyOrder.size(), nullptr);
+        slots.worlds.assign(hierarchyOrder.size(), nullptr);
+        for(unsigned slot = 0; slot < hierarchyOrder.size(); slot++){
+            ID entityID = hierarchyOrder[slot].entity;
+            if(locals->hasEntity(entityID)){
+                slots.locals[slot] = peekComponent(*locals, entityID);
+            }
+            if(worlds->hasEntity(entityID)){
+                slots.worlds[slot] = peekComponent(*worlds, entityID);
+            }
+        }
+        slots.orderVersion = hierarchyOrderVersion;
+        slots.localVersion = locals->structureVersion();
+        slots.worldVersion = worlds->structureVersion();
+    }
+    // written worlds have to reach double buffered readers and any spatial index over World
+    ISpatialIndex* worldIndex = nullptr;
+    auto indexed = spatialIndexes.find(typeid(World).name());
+    if(indexed != spatialIndexes.end()){
+        worldIndex = indexed->second.get();
+    }
+    // which slots got a new world value this pass
+    vector<char> updated(hierarchyOrder.size(), 0);
+    for(unsigned slot = 0; slot < hierarchyOrder.size(); slot++){
+        const HierarchyNode& node = hierarchyOrder[slot];
+        Hierarchy& links = *node.links;
+        bool isRoot = node.parentSlot == static_cast<unsigned>(-1);
+        // skip if neither this entity nor anything above it changed
+        if(!links.dirty && (isRoot || !updated[node.parentSlot])){
+            continue;
+        }
+        links.dirty = false;
+        // entities without transform data still pass dirtiness down
+        updated[slot] = 1;
+        if(!slots.locals[slot] || !slots.worlds[slot]){
+            continue;
+        }
+        const World* parentWorld = isRoot ? nullptr : slots.worlds[node.parentSlot];
+        *slots.worlds[slot] = combine(parentWorld, *slots.locals[slot]);
+        markWritten(*worlds, node.entity);
+        if(worldIndex != nullptr){
+            worldIndex->entityChanged(node.entity);
+        }
+    }
+}
+
+// ------- Spatial indexes ------- //
+
+template <typename T>
+SpatialIndex<T>& ECSManager::createSpatialIndex(float cellSize){
+    const char* typekey = typeid(T).name();
+    // build over whatever already exists
+    auto index = std::make_shared<SpatialIndex<T>>(components.getComponentVector<T>(), signatures, cellSize);
+    spatialIndexes[typekey] = index;
+    return *index;
+}
+
+template <typename T>
+SpatialIndex<T>& ECSManager::getSpatialIndex(){
+    auto found = spatialIndexes.find(typeid(T).name());
+    if(found == spatialIndexes.end()){
+        throw "error: no spatial index for component";
+    }
+    return *std::static_pointer_cast<SpatialIndex<T>>(found->second);
+}
+
+template <typename T>
+void ECSManager::markChanged(ID entityID){
+    // double buffered components copy the write forward on the next swap
+    if constexpr (std::is_same<ComponentStorage<T>, BufferedVector<T>>::value){
+        components.getComponentVector<T>()->markDirty(entityID);
+    }
+    // nothing else to do unless something is derived from this component type
+    if(spatialIndexes.empty()){
+        return;
+    }
+    auto found = spatialIndexes.find(typeid(T).name());
+    if(found != spatialIndexes.end()){
+        found->second->entityChanged(entityID);
+    }
+}
+
+void ECSManager::swapBuffers(){
+    components.swapBuffers();
+}
+
+template <typename T>
+const T& ECSManager::readComponent(ID entityID){
+    static_assert(StorageTraits<T>::mode == StorageMode::Buffered, "error: readComponent needs a double buffered component");
+    return components.getComponentVector<T>()->read(entityID);
+}
+
+void ECSManager::flushSpatialIndexes(){
+    for(const auto& [key, value] : spatialIndexes){
+        value->flush();
+    }
+}
+
+// ------- Prefabs ------- //
+
+template <typename T>
+void PrefabComponent<T>::instantiate(ECSManager& manager, const vector<ID>& entityIDs){
+    manager.addComponents<T>(entityIDs, component);
+}
+
+template <typename T>
+void PrefabComponent<T>::reset(ECSManager& manager, ID entityID){
+    if(manager.hasComponent<T>(entityID)){
+        // overwrite in place, nothing is allocated
+        manager.getComponent<T>(entityID) = component;
+        manager.markChanged<T>(entityID);
+    } else {
+        manager.addComponent<T>(entityID, component);
+    }
+}
+
+template <typename T>
+Prefab& Prefab::add(T component){
+    // check and see if object is derived from Component
+    if constexpr (is_base_of<Component,T>::value == 1){
+        components.emplace_back(std::make_unique<PrefabComponent<T>>(component));
+    }
+    return *this;
+}
+
+Prefab& ECSManager::createPrefab(string prefabName){
+    auto old = prefabs.find(prefabName);
+    if(old != prefabs.end()){
+        // parked instances go with the old prefab, live ones stop being pooled
+        for(ID entityID : old->second.pool){
+            poolOwners[entityID] = nullptr;
+            destroyEntity(entityID);
+        }
+        for(Prefab*& owner : poolOwners){
+            if(owner == &old->second){
+                owner = nullptr;
+            }
+        }
+        prefabs.erase(old);
+    }
+    return prefabs.emplace(prefabName, Prefab(prefabName)).first->second;
+}
+
+Prefab& ECSManager::getPrefab(const string& prefabName){
+    auto found = prefabs.find(prefabName);
+    if(found == prefabs.end()){
+        throw "error: no prefab with name";
+    }
+    return found->second;
+}
+
+vector<ID> ECSManager::instantiate(Prefab& prefab, unsigned count, const std::function<void(ID, unsigned)>& customize){
+    vector<ID> entityIDs;
+    entityIDs.reserve(count);
+    // recycled instances first, they only need their values reset
+    while(entityIDs.size() < count && !prefab.pool.empty()){
+        entityIDs.emplace_back(prefab.pool.back());
+        prefab.pool.pop_back();
+        resetInstance(prefab, entityIDs.back());
+    }
+    size_t reused = entityIDs.size();
+    // make the rest of the entities
+    for(size_t i = reused; i < count; i++){
+        entityIDs.emplace_back(createEntity().getID());
+    }
+    if(reused < count){
+        // then fill each component type in one go
+        vector<ID> freshIDs(entityIDs.begin() + reused, entityIDs.end());
+        for(const unique_ptr<IPrefabComponent>& component : prefab.components){
+            component->instantiate(*this, reused == 0 ? entityIDs : freshIDs);
+        }
+        // remember where pooled instances go back to
+        if(prefab.pooled){
+            if(poolOwners.size() < idAllocator.issued()){
+                poolOwners.resize(idAllocator.issued(), nullptr);
+            }
+            for(ID entityID : freshIDs){
+                poolOwners[entityID] = &prefab;
+            }
+        }
+    }
+    // per-instance tweaks
+    if(customize){
+        for(unsigned i = 0; i < count; i++){
+            customize(entityIDs[i], i);
+        }
+    }
+    return entityIDs;
+}
+
+vector<ID> ECSManager::instantiate(const string& prefabName, unsigned count, const std::function<void(ID, unsigned)>& customize){
+    return instantiate(getPrefab(prefabName), count, customize);
+}
+
+void ECSManager::poolPrefab(const string& prefabName, unsigned prewarm){
+    Prefab& prefab = getPrefab(prefabName);
+    prefab.pooled = true;
+    // build the warm instances in bulk, then park them all
+    if(prewarm != 0){
+        prefab.pool.reserve(prefab.pool.size() + prewarm);
+        for(ID entityID : instantiate(prefab, prewarm)){
+            release(entityID);
+        }
+    }
+}
+
+ID ECSManager::spawn(Prefab& prefab){
+    if(!prefab.pool.empty()){
+        ID entityID = prefab.pool.back();
+        prefab.pool.pop_back();
+        resetInstance(prefab, entityID);
+        return entityID;
+    }
+    return instantiate(prefab, 1)[0];
+}
+
+void ECSManager::release(ID entityID){
+    Prefab* owner = entityID < poolOwners.size() ? poolOwners[entityID] : nullptr;
+    // not pooled, nothing to keep it around for
+    if(owner == nullptr){
+        destroyEntity(entityID);
+        return;
+    }
+    // releasing twice would hand the same entity out to two spawns
+    if(entityID < parked.size() && parked[entityID]){
+        throw "error: entity is already released";
+    }
+    // park it, the components stay allocated
+    disable(entityID);
+    owner->pool.emplace_back(entityID);
+    if(entityID >= parked.size()){
+        parked.resize(entityID + 1, false);
+    }
+    parked[entityID] = true;
+}
+
+void ECSManager::resetInstance(Prefab& prefab, ID entityID){
+    // out of the pool, can be released again
+    parked[entityID] = false;
+    for(const unique_ptr<IPrefabComponent>& component : prefab.components){
+        component->reset(*this, entityID);
+    }
+    enable(entityID);
+}
+
+// ------- Coroutines ------- //
+
+#ifdef ECPPS_COROUTINES
+Task& Task::operator=(Task&& other) noexcept {
+    if(this != &other){
+        if(handle){
+            handle.destroy();
+        }
+        handle = other.handle;
+        other.handle = nullptr;
+    }
+    return *this;
+}
+
+Task::~Task(){
+    if(handle){
+        handle.destroy();
+    }
+}
+
+bool Task::running() const {
+    return handle && !handle.done();
+}
+
+void Task::resume(){
+    if(running()){
+        handle.resume();
+    }
+}
+
+void Task::rethrow() const {
+    if(handle && handle.promise().exception){
+        std::rethrow_exception(handle.promise().exception);
+    }
+}
+
+void AsyncSystem::update(ECSManager* manager){
+    // still working on the last run, the manager resumes it
+    if(task.running()){
+        return;
+    }
+    // surface errors from the finished run
+    task.rethrow();
+    // start over, running up to the first co_await
+    task = run(manager);
+    task.resume();
+}
+
+void NextFrame::await_suspend(std::coroutine_handle<> handle){
+    if(manager.currentBehaviour.entity != nullEntity){
+        // behaviours can be destroyed while waiting, so they go through the checked queue
+        manager.sleepCoroutine(0, handle);
+    } else {
+        manager.frameWaiters.emplace_back(handle);
+    }
+}
+
+void Wait::await_suspend(std::coroutine_handle<> handle){
+    manager.sleepCoroutine(seconds, handle);
+}
+
+JobPool::~JobPool(){
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    wake.notify_all();
+    for(std::thread& worker : workers){
+        worker.join();
+    }
+}
+
+void JobPool::submit(std::function<void()> job){
+    std::lock_guard<std::mutex> lock(mutex);
+    jobs.push(std::move(job));
+    if(idle == 0 && workers.size() < maxThreads){
+        workers.emplace_back(&JobPool::work, this);
+    } else {
+        wake.notify_one();
+    }
+}
+
+void JobPool::work(){
+    std::unique_lock<std::mutex> lock(mutex);
+    while(true){
+        idle++;
+        wake.wait(lock, [this]{ return stopping || !jobs.empty(); });
+        idle--;
+        if(stopping){
+            return;
+        }
+        std::function<void()> job = std::move(jobs.front());
+        jobs.pop();
+        lock.unlock();
+        // packaged tasks catch the job's exceptions themselves
+        job();
+        lock.lock();
+    }
+}
+
+template <typename R>
+void BackgroundJob<R>::await_suspend(std::coroutine_handle<> handle){
+    // packaged_task futures don't block when destroyed, so the main thread can never get stuck here
+    // shared so the pool can hold it in a std::function, which needs to be copyable
+    auto work = std::make_shared<std::packaged_task<R()>>(std::move(job));
+    result = std::make_shared<std::future<R>>(work->get_future());
+    if(!manager.jobPool){
+        unsigned threads = std::max(1u, std::min(ECSManager::maxJobThreads, std::thread::hardware_concurrency()));
+        manager.jobPool = std::make_unique<JobPool>(threads);
+    }
+    manager.jobPool->submit([work]{ (*work)(); });
+    // the waiter keeps its own reference, this awaiter lives in the coroutine frame
+    std::shared_ptr<std::future<R>> waitingOn = result;
+    manager.jobWaiters.emplace_back(JobWaiter{[waitingOn]{
+        return waitingOn->wait_for(std::chrono::seconds(0)) == std::future_status::ready;
+    }, handle, manager.currentBehaviour});
+}
+
+NextFrame ECSManager::nextFrame(){
+    return NextFrame{*this};
+}
+
+template <typename F>
+BackgroundJob<std::invoke_result_t<F>> ECSManager::runInBackground(F job){
+    return BackgroundJob<std::invoke_result_t<F>>{*this, std::move(job), {}};
+}
+
+Wait ECSManager::wait(double seconds){
+    return Wait{*this, seconds};
+}
+
+void ECSManager::addBehaviour(ID entityID, Task behaviour){
+    Behaviour component;
+    component.task = std::make_shared<Task>(std::move(behaviour));
+    component.serial = ++behaviourSerial;
+    addComponent<Behaviour>(entityID, component);
+    // run up to the first co_await
+    resumeOwned(nullptr, BehaviourOwner{entityID, component.serial});
+}
+
+void ECSManager::sleepCoroutine(double seconds, std::coroutine_handle<> handle){
+    timedWaiters.push(TimedWaiter{simulationTime + seconds, nextWaiterOrder++, handle, currentBehaviour});
+}
+
+bool ECSManager::ownerAlive(BehaviourOwner owner){
+    // coroutines not owned by an entity are kept alive by their system
+    if(owner.entity == nullEntity){
+        return true;
+    }
+    // entity (or its behaviour) may be gone, in which case the coroutine frame is too
+    return hasComponent<Behaviour>(owner.entity) && getComponent<Behaviour>(owner.entity).serial == owner.serial;
+}
+
+void ECSManager::resumeOwned(std::coroutine_handle<> handle, BehaviourOwner owner){
+    if(owner.entity == nullEntity){
+        handle.resume();
+        return;
+    }
+    if(!ownerAlive(owner)){
+        return;
+    }
+    // hold on to the task in case the component storage moves while it runs
+    std::shared_ptr<Task> task = getComponent<Behaviour>(owner.entity).task;
+    BehaviourOwner previous = currentBehaviour;
+    currentBehaviour = owner;
+    task->resume();
+    currentBehaviour = previous;
+    // surface errors once the behaviour finishes
+    if(!task->running()){
+        task->rethrow();
+    }
+}
+
+void ECSManager::resumeCoroutines(){
+    // take the current waiters, anything that suspends again waits for the frame after
+    vector<std::coroutine_handle<>> resuming;
+    resuming.swap(frameWaiters);
+    for(std::coroutine_handle<> handle : resuming){
+        handle.resume();
+    }
+    // pull out finished jobs (never blocks, unfinished ones just stay queued)
+    // waiters whose behaviour was destroyed are dropped, their job runs out on its own
+    vector<JobWaiter> finished;
+    for(size_t i = 0; i < jobWaiters.size();){
+        if(!ownerAlive(jobWaiters[i].owner)){
+            jobWaiters[i] = std::move(jobWaiters.back());
+            jobWaiters.pop_back();
+        } else if(jobWaiters[i].ready()){
+            finished.emplace_back(std::move(jobWaiters[i]));
+            jobWaiters[i] = std::move(jobWaiters.back());
+            jobWaiters.pop_back();
+        } else {
+            i++;
+        }
+    }
+    for(JobWaiter& waiter : finished){
+        resumeOwned(waiter.handle, waiter.owner);
+    }
+    // wake sleepers whose time has come, only expired ones are touched
+    // (anything that sleeps again while resuming goes back in with a later time, or waits until next frame)
+    double now = simulationTime;
+    vector<TimedWaiter> waking;
+    while(!timedWaiters.empty() && timedWaiters.top().wakeTime <= now){
+        waking.emplace_back(timedWaiters.top());
+        timedWaiters.pop();
+    }
+    for(TimedWaiter& waiter : waking){
+        resumeOwned(waiter.handle, waiter.owner);
+    }
+}
+#endif
+
+// ------- Fixed timestep ------- //
+
+void ECSManager::setFixedTimestep(double deltaTime, unsigned maxSteps){
+    fixedDeltaTime = deltaTime;
+    // always allow at least one step per tick
+    maxStepsPerTick = maxSteps == 0 ? 1 : maxSteps;
+}
+
+unsigned ECSManager::tick(double frameSeconds){
+    accumulator += frameSeconds;
+    // count whole steps up front (repeated subtraction drifts and can lose a step)
+    double due = std::floor(accumulator / fixedDeltaTime);
+    if(due > maxStepsPerTick){
+        // a long frame would otherwise need more and more steps to catch up (spiral of death), drop the backlog
+        due = maxStepsPerTick;
+        accumulator = 0;
+    } else {
+        accumulator = std::max(0.0, accumulator - due * fixedDeltaTime);
+    }
+    // run whole steps
+    unsigned steps = static_cast<unsigned>(due);
+    for(unsigned step = 0; step < steps; step++){
+        update();
+    }
+    // render somewhere between the last two steps
+    alpha = accumulator / fixedDeltaTime;
+    render();
+    return steps;
+}
+
+unsigned ECSManager::tick(){
+    auto now = std::chrono::steady_clock::now();
+    // first tick has nothing to measure against
+    double frameSeconds = hasTicked ? std::chrono::duration<double>(now - lastTick).count() : 0;
+    lastTick = now;
+    hasTicked = true;
+    return tick(frameSeconds);
+}
+
+double ECSManager::getDeltaTime() const {
+    return fixedDeltaTime;
+}
+
+double ECSManager::getAlpha() const {
+    return alpha;
+}
+
+double ECSManager::getSimulationTime() const {
+    return simulationTime;
+}
+
+// ------- Profiling ------- //
+
+void SystemProfile::addSample(float micros){
+    // write over oldest sample
+    window[next] = micros;
+    next = (next + 1) % ECPPS_PROFILE_WINDOW;
+    // window fills up until it starts wrapping
+    if(count < ECPPS_PROFILE_WINDOW){
+        count++;
+    }
+    calls++;
+}
+
+SystemStats SystemProfile::getStats() const {
+    SystemStats stats;
+    stats.phase = phase;
+    stats.calls = calls;
+    stats.samples = count;
+    // nothing sampled yet
+    if(count == 0){
+        return stats;
+    }
+    // copy window so it can be partially sorted
+    float sorted[ECPPS_PROFILE_WINDOW];
+    std::copy(window, window + count, sorted);
+    // get min and average
+    double total = 0;
+    stats.min = sorted[0];
+    for(unsigned i = 0; i < count; i++){
+        total += sorted[i];
+        stats.min = std::min<double>(stats.min, sorted[i]);
+    }
+    stats.avg = total / count;
+    // p99 is the sample at the 99th percentile rank
+    unsigned rank = (count * 99 + 99) / 100 - 1;
+    std::nth_element(sorted, sorted + rank, sorted + count);
+    stats.p99 = sorted[rank];
+    return stats;
+}
+
+void SystemProfile::reset(){
+    next = 0;
+    count = 0;
+    calls = 0;
+}
+
+template <typename F>
+void ECSManager::timeSystem(const SystemTimers& timers, SystemProfile& profile, F call){
+    // fast path, nothing to record
+    if(!sampling){
+        call();
+        return;
+    }
+    // time the call
+    auto start = std::chrono::steady_clock::now();
+    call();
+    auto end = std::chrono::steady_clock::now();
+    // convert to microseconds
+    double duration = std::chrono::duration<double, std::micro>(end - start).count();
+    profile.addSample(duration);
+    // record trace event if tracing
+    if(!traceEvents.empty()){
+        double offset = std::chrono::duration<double, std::micro>(start - profileStart).count();
+        traceEvents[nextTraceEvent] = {timers.name, profile.phase, offset, duration};
+        nextTraceEvent++;
+        // wrap around, overwriting oldest events
+        if(nextTraceEvent == traceEvents.size()){
+            nextTraceEvent = 0;
+            traceWrapped = true;
+        }
+    }
+}
+
+void ECSManager::enableProfiling(unsigned sampleRate, size_t traceCapacity){
+    // sample rate of 0 would never sample, treat as every frame
+    this->sampleRate = sampleRate == 0 ? 1 : sampleRate;
+    profiling = true;
+    profileFrame = 0;
+    profileStart = std::chrono::steady_clock::now();
+    // allocate the whole trace ring up front
+    traceEvents.assign(traceCapacity, TraceEvent{});
+    nextTraceEvent = 0;
+    traceWrapped = false;
+    // start stats fresh
+    for(SystemEntry& entry : systems){
+        entry.timers.init.reset();
+        entry.timers.update.reset();
+        entry.timers.render.reset();
+    }
+}
+
+void ECSManager::disableProfiling(){
+    profiling = false;
+    sampling = false;
+}
+
+vector<SystemStats> ECSManager::getSystemStats(){
+    vector<SystemStats> stats;
+    // collect every profile that has been sampled at least once
+    for(SystemEntry& entry : systems){
+        SystemTimers& timers = entry.timers;
+        for(SystemProfile* profile : {&timers.init, &timers.update, &timers.render}){
+            SystemStats profileStats = profile->getStats();
+            if(profileStats.calls != 0){
+                profileStats.name = profileNames[timers.name];
+                stats.emplace_back(profileStats);
+            }
+        }
+    }
+    return stats;
+}
+
+void ECSManager::exportTrace(std::ostream& out){
+    // writes a string as a json string literal
+    auto writeString = [&](const string& text){
+        out << '"';
+        for(char c : text){
+            if(c == '"' || c == '\\'){
+                out << '\\' << c;
+            } else if(static_cast<unsigned char>(c) < 0x20){
+                out << ' ';
+            } else {
+                out << c;
+            }
+        }
+        out << '"';
+    };
+    // timestamps are microseconds, keep sub-microsecond precision without switching to exponents
+    std::ios_base::fmtflags flags = out.flags();
+    std::streamsize precision = out.precision();
+    out << std::fixed << std::setprecision(3);
+    out << "{\"traceEvents\":[";
+    // oldest event is at the write position once the ring has wrapped
+    size_t count = traceWrapped ? traceEvents.size() : nextTraceEvent;
+    size_t first = traceWrapped ? nextTraceEvent : 0;
+    for(size_t i = 0; i < count; i++){
+        const TraceEvent& event = traceEvents[(first + i) % traceEvents.size()];
+        if(i != 0){
+            out << ",";
+        }
+        out << "{\"name\":";
+        writeString(profileNames[event.name]);
+        out << ",\"cat\":\"" << event.phase << "\",\"ph\":\"X\",\"ts\":" << event.start
+            << ",\"dur\":" << event.duration << ",\"pid\":0,\"tid\":0}";
     }
+    out << "],\"displayTimeUnit\":\"ms\"}";
+    // put stream formatting back how it was
+    out.flags(flags);
+    out.precision(precision);
 }
 
 };
@@ -0,0 +1,100 @@
+// randomized churn soak test for ECSManager
+// build and run from the repo root:
+//   g++ -std=c++17 -O2 -pthread soak/soak.cpp -o soak_test && ./soak_test [operations] [batch] [seed]
+// runs random create/destroy/add/remove/get/disable operations, checks the manager's invariants
+// after every batch, prints throughput per batch, and fails on a broken invariant or a performance cliff
+#include "../ecpps.h"
+#include <random>
+#include <cstdlib>
+
+using namespace ecpps;
+
+struct Position : Component { float x = 0, y = 0; };
+struct Velocity : Component { float x = 0, y = 0; };
+struct Health : Component { int hp = 100; };
+struct Frozen : Component {};
+
+int main(int argc, char** argv){
+    long operations = argc > 1 ? std::atol(argv[1]) : 2000000;
+    long batch = argc > 2 ? std::atol(argv[2]) : 50000;
+    unsigned seed = argc > 3 ? std::atoi(argv[3]) : 1;
+    // a batch this much slower than the fastest one so far counts as a cliff
+    const double cliffRatio = 8.0;
+
+    ECSManager manager;
+    std::mt19937 rng(seed);
+    vector<ID> live;
+    double bestRate = 0;
+    auto batchStart = std::chrono::steady_clock::now();
+
+    std::cout << std::setw(12) << "operations" << std::setw(10) << "live" << std::setw(14) << "ops/sec" << std::endl;
+    for(long op = 1; op <= operations; op++){
+        unsigned roll = rng() % 100;
+        // keep the population drifting up and down rather than growing forever
+        bool growing = (op / (batch * 10)) % 2 == 0;
+        if(live.empty() || roll < (growing ? 30u : 15u)){
+            live.emplace_back(manager.createEntity().getID());
+        } else if(roll < 40){
+            size_t pick = rng() % live.size();
+            manager.destroyEntity(live[pick]);
+            live[pick] = live.back();
+            live.pop_back();
+        } else if(roll < 65){
+            ID entityID = live[rng() % live.size()];
+            switch(rng() % 4){
+                case 0: manager.addComponent<Position>(entityID, Position()); break;
+                case 1: manager.addComponent<Velocity>(entityID, Velocity()); break;
+                case 2: manager.addComponent<Health>(entityID, Health()); break;
+                default: manager.addComponent<Frozen>(entityID, Frozen()); break;
+            }
+        } else if(roll < 75){
+            ID entityID = live[rng() % live.size()];
+            switch(rng() % 3){
+                case 0: manager.removeComponent<Position>(entityID); break;
+                case 1: manager.removeComponent<Velocity>(entityID); break;
+                default: manager.removeComponents<Health, Frozen>(entityID); break;
+            }
+        } else if(roll < 80){
+            ID entityID = live[rng() % live.size()];
+            if(manager.isEnabled(entityID)){
+                manager.disable(entityID);
+            } else {
+                manager.enable(entityID);
+            }
+        } else {
+            // reads must agree with the signature
+            ID entityID = live[rng() % live.size()];
+            if(manager.hasComponent<Health>(entityID) && manager.getComponent<Health>(entityID).hp != 100){
+                std::cerr << "FAIL: health of entity " << entityID << " was corrupted" << std::endl;
+                return 1;
+            }
+        }
+
+        if(op % batch == 0){
+            auto now = std::chrono::steady_clock::now();
+            double rate = batch / std::chrono::duration<double>(now - batchStart).count();
+            std::cout << std::setw(12) << op << std::setw(10) << live.size() << std::setw(14) << static_cast<long>(rate) << std::endl;
+            // correctness
+            string problem = manager.checkInvariants();
+            if(!problem.empty()){
+                std::cerr << "FAIL after " << op << " operations: " << problem << std::endl;
+                return 1;
+            }
+            // performance
+            bestRate = std::max(bestRate, rate);
+            if(rate * cliffRatio < bestRate){
+                std::cerr << "FAIL after " << op << " operations: throughput fell to " << static_cast<long>(rate)
+                    << " ops/sec from a best of " << static_cast<long>(bestRate) << std::endl;
+                return 1;
+            }
+            // new components join the regular entity sets, like after a frame's init
+            manager.groupEntities<Position>();
+            manager.groupEntities<Velocity>();
+            manager.groupEntities<Health>();
+            // invariant checking isn't part of the timed work
+            batchStart = std::chrono::steady_clock::now();
+        }
+    }
+    std::cout << "ok" << std::endl;
+    return 0;
+}